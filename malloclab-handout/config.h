@@ -51,14 +51,18 @@
 #define UTIL_WEIGHT .60
 
 /* 
- * Alignment requirement in bytes (either 4 or 8) 
+ * Alignment requirement in bytes (16, as for malloc on 64-bit targets) 
  */
-#define ALIGNMENT 8  
+#define ALIGNMENT 16  
 
 /* 
- * Maximum heap size in bytes 
+ * Default heap size in bytes, per region: the address space mem_init
+ * reserves unless mem_set_max_heap says otherwise. Builds that need more,
+ * such as libmm.so, define it on the command line.
  */
+#ifndef MAX_HEAP
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
+#endif
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
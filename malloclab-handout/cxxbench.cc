@@ -0,0 +1,175 @@
+/*
+ * cxxbench.cc - STL container benchmark for mm's operator new and delete
+ *
+ * Builds and destroys a std::map, a std::list and a vector of std::strings
+ * over and over, first through std::allocator, which mm_new.cc sends to
+ * mm (with sized deletes), then through an allocator that calls libc's
+ * malloc and free, and reports the time of each and their ratio.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <map>
+#include <list>
+#include <string>
+#include <vector>
+
+#define DEFAULT_OBJS 20000      /* elements per container */
+#define DEFAULT_ROUNDS 50       /* times each container is built */
+#define MIN_STRING 16           /* past the short-string buffer */
+#define MAX_STRING 256
+
+static int objs = DEFAULT_OBJS;
+static int rounds = DEFAULT_ROUNDS;
+static volatile size_t sink;    /* keeps the work from being optimized away */
+
+static void usage(void);
+
+/*
+ * libc_allocator - a std::allocator that calls libc's malloc and free
+ */
+template <class T>
+struct libc_allocator {
+    typedef T value_type;
+
+    libc_allocator() noexcept {}
+    template <class U> libc_allocator(const libc_allocator<U> &) noexcept {}
+
+    T *allocate(std::size_t n)
+    {
+        void *p = std::malloc(n * sizeof(T));
+
+        if (p == nullptr)
+            throw std::bad_alloc();
+        return static_cast<T *>(p);
+    }
+    void deallocate(T *p, std::size_t) noexcept { std::free(p); }
+};
+
+template <class T, class U>
+bool operator==(const libc_allocator<T> &, const libc_allocator<U> &) { return true; }
+template <class T, class U>
+bool operator!=(const libc_allocator<T> &, const libc_allocator<U> &) { return false; }
+
+/*
+ * bench_map - inserts objs pseudo-random keys into a map, then drops it
+ */
+template <template <class> class A>
+static void bench_map(unsigned int seed)
+{
+    std::map<int, int, std::less<int>, A<std::pair<const int, int>>> m;
+    int i;
+
+    for (i = 0; i < objs; i++) {
+        seed = seed * 1103515245 + 12345;
+        m[(int)(seed >> 1)] = i;
+    }
+    sink += m.size();
+}
+
+/*
+ * bench_list - appends objs elements to a list, then drops it
+ */
+template <template <class> class A>
+static void bench_list(unsigned int)
+{
+    std::list<int, A<int>> l;
+    int i;
+
+    for (i = 0; i < objs; i++)
+        l.push_back(i);
+    sink += l.size();
+}
+
+/*
+ * bench_string - fills a vector with objs strings of MIN_STRING to
+ * MAX_STRING characters, then drops it
+ */
+template <template <class> class A>
+static void bench_string(unsigned int seed)
+{
+    typedef std::basic_string<char, std::char_traits<char>, A<char>> string_t;
+    std::vector<string_t, A<string_t>> v;
+    int i;
+
+    for (i = 0; i < objs; i++) {
+        seed = seed * 1103515245 + 12345;
+        v.emplace_back(MIN_STRING + (seed >> 8) % (MAX_STRING - MIN_STRING), 'x');
+    }
+    sink += v.size();
+}
+
+/*
+ * run - times rounds calls of f, returns elapsed seconds
+ */
+static double run(void (*f)(unsigned int))
+{
+    struct timespec start, end;
+    int r;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (r = 0; r < rounds; r++)
+        f((unsigned int)r + 1);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/*
+ * report - times one container with mm and with libc and prints a row
+ */
+static void report(const char *name, void (*mm)(unsigned int), void (*libc)(unsigned int))
+{
+    double mm_secs, libc_secs;
+
+    mm(0);      /* warm both heaps up */
+    libc(0);
+    mm_secs = run(mm);
+    libc_secs = run(libc);
+    printf("%-8s%10.4f%10.4f%9.2fx\n", name, mm_secs, libc_secs, libc_secs / mm_secs);
+}
+
+int main(int argc, char **argv)
+{
+    int c;
+
+    while ((c = getopt(argc, argv, "n:r:h")) != EOF) {
+        switch (c) {
+        case 'n': /* Elements per container */
+            objs = atoi(optarg);
+            break;
+        case 'r': /* Times each container is built */
+            rounds = atoi(optarg);
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (objs < 1 || rounds < 1) {
+        usage();
+        exit(1);
+    }
+
+    printf("%-8s%10s%10s%10s\n", "", "mm secs", "libc secs", "speedup");
+    report("map", bench_map<std::allocator>, bench_map<libc_allocator>);
+    report("list", bench_list<std::allocator>, bench_list<libc_allocator>);
+    report("string", bench_string<std::allocator>, bench_string<libc_allocator>);
+    return 0;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: cxxbench [-h] [-n <objects>] [-r <rounds>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h            Print this message.\n");
+    fprintf(stderr, "\t-n <objects>  Elements per container (default %d).\n", DEFAULT_OBJS);
+    fprintf(stderr, "\t-r <rounds>   Times each container is built (default %d).\n", DEFAULT_ROUNDS);
+}
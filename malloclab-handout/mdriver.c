@@ -14,7 +14,13 @@
 #include <string.h>
 #include <assert.h>
 #include <float.h>
+#include <stdint.h>
 #include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
 
 #include "mm.h"
 #include "memlib.h"
@@ -30,8 +36,12 @@
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
+/* Batch benchmark: objects allocated and freed per run, and their sizes */
+#define BATCH_OBJS 4096
+#define BATCH_SIZES {64, 256, 1024, 3000}
+
 /* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
+#define IS_ALIGNED(p)  ((((uintptr_t)(p)) % ALIGNMENT) == 0)
 
 /****************************** 
  * The key compound data types 
@@ -46,9 +56,10 @@ typedef struct range_t {
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
+    enum {ALLOC, FREE, REALLOC, MEMALIGN, CALLOC} type; /* type of request */
     int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
+    int size;                         /* byte size of request, or of the freed block */
+    int align;                        /* payload alignment of a memalign request */
 } traceop_t;
 
 /* Holds the information for one trace file*/
@@ -72,6 +83,24 @@ typedef struct {
     range_t *ranges;
 } speed_t;
 
+/* Holds the params to eval_batch_speed, which is timed by fcyc */
+typedef struct {
+    size_t size;     /* payload bytes of each object */
+    size_t n;        /* objects per batch */
+    int batch;       /* use mm_malloc_batch/mm_free_batch, not one call each */
+} batch_t;
+
+/* Holds the params and results of one trace replayed on a heap of its own */
+typedef struct {
+    trace_t *trace;  
+    int tracenum;
+    int valid;       /* did the trace run correctly? */
+    int badop;       /* if not, the request that failed ... */
+    char *why;       /* ... and how */
+    double util;     /* peak payload over peak heap size */
+    double secs;     /* time to replay the trace */
+} heap_run_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
@@ -82,6 +111,28 @@ typedef struct {
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
 
+    /* per-operation latency in ns, defined only with -L */
+    double lat_p50, lat_p99, lat_p999, lat_max;
+
+    /* peak heap and resident memory growth in KB, defined only with -R */
+    double rss_heap, rss_end, rss_trim;
+
+    /* dTLB load and store misses (-1 if not counted) and huge page KB, only with -X */
+    double tlb_loads, tlb_stores, huge_kb;
+
+    /* on a cold heap, mm_init usecs and ns per op of the first -N ops and 
+       of the rest, with the page faults of each, only with -N */
+    double init_us, first_ns, rest_ns, init_faults, first_faults, rest_faults;
+
+    /* sbrk calls and heap high-water mark in bytes of the util run */
+    double sbrks, heap_peak;
+
+    /* util and secs with eager [0] and deferred [1] coalescing, only with -D */
+    double defer_util[2], defer_secs[2];
+
+    /* util and secs under each MM_FIT_xxx placement policy, only with -P */
+    double fit_util[MM_NUM_FITS], fit_secs[MM_NUM_FITS];
+
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
 
@@ -90,6 +141,8 @@ typedef struct {
  *******************/
 int verbose = 0;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
+static int sized = 0;   /* free with mm_free_sized and check mm_usable_size (-s) */
+static int tlb_fds[2] = {-1, -1}; /* dTLB load and store miss counters (-X) */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
 /* Directory where default tracefiles are found */
@@ -122,11 +175,42 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
+static int eval_mm_huge(int tracenum, int opnum);
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace, stats_t *stats);
+static void eval_mm_first(trace_t *trace, int n, stats_t *stats);
+static int checked_size(char *p, int size, int tracenum, int opnum);
+static void *mm_alloc(traceop_t *op);
+static void *libc_alloc(traceop_t *op);
+static void mm_free_trace(void *p, int size);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printlatency(int n, stats_t *stats);
+static void printfirst(int n, int first, stats_t *stats);
+static long minor_faults(void);
+static void eval_mm_rss(trace_t *trace, stats_t *stats);
+static void printrss(int n, stats_t *stats);
+static long rss_kb(void);
+static void tlb_open(void);
+static void eval_mm_tlb(speed_t *speed, stats_t *stats);
+static void printtlb(int n, stats_t *stats);
+static long huge_kb(void);
+static void eval_mm_defer(trace_t *trace, int tracenum, speed_t *speed, 
+                          stats_t *stats);
+static void printdefer(int n, stats_t *stats);
+static void eval_mm_fits(trace_t *trace, int tracenum, speed_t *speed, 
+                         stats_t *stats);
+static void printfits(int n, stats_t *stats);
+static void *refit_block(int fit);
+static void printgrowth(int n, stats_t *stats);
+static void eval_batch_speed(void *ptr);
+static void printbatch(size_t n);
+static void *eval_heap_trace(void *ptr);
+static void eval_heaps(char *tracedir, char **tracefiles, int n);
+static double elapsed(const struct timespec *start);
+static double between(const struct timespec *start, const struct timespec *end);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -150,6 +234,16 @@ int main(int argc, char **argv)
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int latency = 0;     /* If set, measure per-op latency of mm (-L) */
+    int rss = 0;         /* If set, report resident memory of mm (-R) */
+    int defer_cmp = 0;   /* If set, compare eager and deferred coalescing (-D) */
+    int growth = 0;      /* If set, report heap growth of mm (-H) */
+    int fit_cmp = 0;     /* If set, compare the placement policies (-P) */
+    size_t batch = 0;    /* If set, benchmark batches of this many objects (-B) */
+    int heaps = 0;       /* If set, run the traces at once on their own heaps (-C) */
+    int tlb = 0;         /* If set, report dTLB misses of mm (-X) */
+    int first = 0;       /* If set, time this many first ops of mm apart (-N) */
+    char *scan;
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -158,7 +252,7 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:e:c:m:p:r:w:B:N:hvVgaCdDlHLPRsTuX")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -184,6 +278,99 @@ int main(int argc, char **argv)
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'e': /* Select the mm free-block index engine */
+            if (!strcmp(optarg, "seglist"))
+                mm_opts.engine = MM_ENGINE_SEGLIST;
+            else if (!strcmp(optarg, "tlsf"))
+                mm_opts.engine = MM_ENGINE_TLSF;
+            else {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'c': /* Select the mm heap growth policy */
+            if (!strcmp(optarg, "fixed"))
+                mm_opts.growth = MM_GROWTH_FIXED;
+            else if (!strcmp(optarg, "adaptive"))
+                mm_opts.growth = MM_GROWTH_ADAPTIVE;
+            else {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'H': /* Report sbrk calls and heap high-water mark of mm malloc */
+            growth = 1;
+            break;
+        case 'p': /* Select the mm placement policy, good fit with a scan */
+            if ((scan = strchr(optarg, ':')) != NULL) {
+                *scan++ = '\0';
+                mm_opts.fit_scan = atoi(scan);
+            }
+            if (!strcmp(optarg, "first"))
+                mm_opts.placement = MM_FIT_FIRST;
+            else if (!strcmp(optarg, "next"))
+                mm_opts.placement = MM_FIT_NEXT;
+            else if (!strcmp(optarg, "best"))
+                mm_opts.placement = MM_FIT_BEST;
+            else if (!strcmp(optarg, "good"))
+                mm_opts.placement = MM_FIT_GOOD;
+            else {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'P': /* Compare the placement policies */
+            fit_cmp = 1;
+            break;
+        case 'B': /* Compare batch and per-call malloc and free */
+            batch = strtoul(optarg, NULL, 0);
+            if (batch == 0 || batch > BATCH_OBJS) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 's': /* Free with sizes, checking them against the usable sizes */
+            sized = 1;
+            break;
+        case 'C': /* Run all traces at once, each on a heap of its own */
+            heaps = 1;
+            break;
+        case 'd': /* Run mm malloc with deferred coalescing */
+            mm_opts.defer_coalesce = 1;
+            break;
+        case 'D': /* Compare eager and deferred coalescing */
+            defer_cmp = 1;
+            break;
+        case 'L': /* Measure per-operation latency of mm malloc */
+            latency = 1;
+            break;
+        case 'm': /* Give mm malloc requests of this many bytes a mapping */
+            mm_opts.mmap_threshold = strtoul(optarg, NULL, 0);
+            break;
+        case 'r': /* Give free blocks of this many bytes back to the OS */
+            mm_opts.trim_threshold = strtoul(optarg, NULL, 0);
+            break;
+        case 'w': /* Fault in this many bytes of the mm heap at mm_init */
+            mm_opts.prefault = strtoul(optarg, NULL, 0);
+            break;
+        case 'N': /* Time the first ops of each trace on a cold heap apart */
+            if ((first = atoi(optarg)) <= 0) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'R': /* Report resident memory of mm malloc */
+            rss = 1;
+            break;
+        case 'T': /* Run mm malloc in thread-safe mode */
+            mm_opts.thread_safe = 1;
+            break;
+        case 'u': /* Back the mm heap with huge pages */
+            mem_set_hugepages(1);
+            break;
+        case 'X': /* Report dTLB misses of mm malloc */
+            tlb = 1;
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -286,6 +473,12 @@ int main(int argc, char **argv)
     
     /* Initialize the simulated memory system in memlib.c */
     mem_init(); 
+    if (mem_region_backing(mem_default_region()) == MEM_PAGES_HUGETLB)
+	printf("Heap backed by hugetlbfs pages\n");
+    else if (mem_region_backing(mem_default_region()) == MEM_PAGES_THP)
+	printf("Heap backed by transparent huge pages\n");
+    if (tlb)
+	tlb_open();
 
     /* Evaluate student's mm malloc package using the K-best scheme */
     for (i=0; i < num_tracefiles; i++) {
@@ -298,11 +491,25 @@ int main(int argc, char **argv)
 	    if (verbose > 1)
 		printf("efficiency, ");
 	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
+	    mm_stats[i].sbrks = mem_sbrk_calls();
+	    mm_stats[i].heap_peak = mem_heap_peak();
 	    speed_params.trace = trace;
 	    speed_params.ranges = ranges;
 	    if (verbose > 1)
 		printf("and performance.\n");
 	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+	    if (latency)
+		eval_mm_latency(trace, &mm_stats[i]);
+	    if (first)
+		eval_mm_first(trace, first, &mm_stats[i]);
+	    if (rss)
+		eval_mm_rss(trace, &mm_stats[i]);
+	    if (tlb)
+		eval_mm_tlb(&speed_params, &mm_stats[i]);
+	    if (defer_cmp)
+		eval_mm_defer(trace, i, &speed_params, &mm_stats[i]);
+	    if (fit_cmp)
+		eval_mm_fits(trace, i, &speed_params, &mm_stats[i]);
 	}
 	free_trace(trace);
     }
@@ -314,6 +521,72 @@ int main(int argc, char **argv)
 	printf("\n");
     }
 
+    /* Display the mm per-operation latency distribution */
+    if (latency) {
+	printf("Latency for mm malloc (ns per op):\n");
+	printlatency(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+
+    /* Display the time and page faults of the first ops of each trace */
+    if (first) {
+	printf("First %d ops of mm malloc on a cold heap (ns per op, page faults):\n", first);
+	printfirst(num_tracefiles, first, mm_stats);
+	printf("\n");
+    }
+
+    /* Display the mm resident memory at the end of each trace */
+    if (rss) {
+	printf("Resident memory of mm malloc (KB above an empty heap):\n");
+	printrss(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+
+    /* Display the dTLB misses of each trace */
+    if (tlb) {
+	printf("dTLB misses of mm malloc (one run of each trace, user mode):\n");
+	printtlb(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+
+    /* Display how the heap grew on each trace */
+    if (growth) {
+	printf("Heap growth of mm malloc:\n");
+	printgrowth(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+
+    /* Display the util and throughput of eager and deferred coalescing */
+    if (defer_cmp) {
+	printf("Eager vs deferred coalescing in mm malloc:\n");
+	printdefer(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+
+    /* Display the util and throughput of each placement policy */
+    if (fit_cmp) {
+	printf("Placement policies of mm malloc (util / Kops):\n");
+	printfits(num_tracefiles, mm_stats);
+	if (refit_block(MM_FIT_NEXT) == refit_block(MM_FIT_FIRST))
+	    printf("ERROR: next fit placed a block where first fit does\n");
+	printf("\n");
+    }
+
+    /* Display the throughput of batch and per-call malloc and free */
+    if (batch) {
+	printf("Batch vs per-call mm malloc, %lu objects per batch (Kops):\n",
+	       (unsigned long)batch);
+	printbatch(batch);
+	printf("\n");
+    }
+
+    /* Display the traces run one after another and at once on their own heaps */
+    if (heaps) {
+	printf("Traces on independent mm heaps, one per trace:\n");
+	eval_heaps(tracedir, tracefiles, num_tracefiles);
+	printf("\n");
+    }
+
     /* 
      * Accumulate the aggregate statistics for the student's mm package 
      */
@@ -395,9 +668,13 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* 
+     * The payload must lie within the extent of the heap, unless mm malloc
+     * gave the request a mapping of its own
+     */
+    if ((mm_opts.mmap_threshold == 0 || size < mm_opts.mmap_threshold) &&
+        ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
+	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi()))) {
 	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
 		lo, hi, mem_heap_lo(), mem_heap_hi());
 	malloc_error(tracenum, opnum, msg);
@@ -477,7 +754,7 @@ static trace_t *read_trace(char *tracedir, char *filename)
     trace_t *trace;
     char type[MAXLINE];
     char path[MAXLINE];
-    unsigned index, size;
+    unsigned index, size, align;
     unsigned max_index = 0;
     unsigned op_index;
 
@@ -525,6 +802,27 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	    trace->ops[op_index].type = ALLOC;
 	    trace->ops[op_index].index = index;
 	    trace->ops[op_index].size = size;
+	    if (index < trace->num_ids)
+		trace->block_sizes[index] = size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'm':
+	    fscanf(tracefile, "%u %u %u", &index, &size, &align);
+	    trace->ops[op_index].type = MEMALIGN;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    trace->ops[op_index].align = align;
+	    if (index < trace->num_ids)
+		trace->block_sizes[index] = size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'c':
+	    fscanf(tracefile, "%u %u", &index, &size);
+	    trace->ops[op_index].type = CALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    if (index < trace->num_ids)
+		trace->block_sizes[index] = size;
 	    max_index = (index > max_index) ? index : max_index;
 	    break;
 	case 'r':
@@ -532,12 +830,16 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	    trace->ops[op_index].type = REALLOC;
 	    trace->ops[op_index].index = index;
 	    trace->ops[op_index].size = size;
+	    if (index < trace->num_ids)
+		trace->block_sizes[index] = size;
 	    max_index = (index > max_index) ? index : max_index;
 	    break;
 	case 'f':
 	    fscanf(tracefile, "%ud", &index);
 	    trace->ops[op_index].type = FREE;
 	    trace->ops[op_index].index = index;
+	    if (index < trace->num_ids)   /* for mm_free_sized */
+		trace->ops[op_index].size = trace->block_sizes[index];
 	    break;
 	default:
 	    printf("Bogus type character (%c) in tracefile %s\n", 
@@ -580,6 +882,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     int index;
     int size;
     int oldsize;
+    int usable;
     char *newp;
     char *oldp;
     char *p;
@@ -602,19 +905,44 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
+        case MEMALIGN: /* mm_memalign */
+        case CALLOC: /* mm_calloc */
 
 	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
+	    if ((p = mm_alloc(&trace->ops[i])) == NULL) {
 		malloc_error(tracenum, i, "mm_malloc failed.");
 		return 0;
 	    }
+
+	    /* A memalign payload must be aligned as asked */
+	    if (trace->ops[i].type == MEMALIGN && 
+		(uintptr_t)p % trace->ops[i].align != 0) {
+		sprintf(msg, "mm_memalign payload (%p) not aligned to %d bytes", 
+			p, trace->ops[i].align);
+		malloc_error(tracenum, i, msg);
+		return 0;
+	    }
+
+	    /* A calloc payload must come back zeroed */
+	    if (trace->ops[i].type == CALLOC) {
+		for (j = 0; j < size; j++)
+		    if (p[j] != 0)
+			break;
+		if (j < size) {
+		    sprintf(msg, "mm_calloc payload (%p) has a nonzero byte at offset %d", 
+			    p, j);
+		    malloc_error(tracenum, i, msg);
+		    return 0;
+		}
+	    }
 	    
 	    /* 
 	     * Test the range of the new block for correctness and add it 
 	     * to the range list if OK. The block must be  be aligned properly,
 	     * and must not overlap any currently allocated block. 
 	     */ 
-	    if (add_range(ranges, p, size, tracenum, i) == 0)
+	    if ((usable = checked_size(p, size, tracenum, i)) == 0 ||
+		add_range(ranges, p, usable, tracenum, i) == 0)
 		return 0;
 	    
 	    /* ADDED: cgw
@@ -622,7 +950,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	     * if we realloc the block and wish to make sure that the old
 	     * data was copied to the new block
 	     */
-	    memset(p, index & 0xFF, size);
+	    memset(p, index & 0xFF, usable);
 
 	    /* Remember region */
 	    trace->blocks[index] = p;
@@ -642,7 +970,8 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    remove_range(ranges, oldp);
 	    
 	    /* Check new block for correctness and add it to range list */
-	    if (add_range(ranges, newp, size, tracenum, i) == 0)
+	    if ((usable = checked_size(newp, size, tracenum, i)) == 0 ||
+		add_range(ranges, newp, usable, tracenum, i) == 0)
 		return 0;
 	    
 	    /* ADDED: cgw
@@ -653,13 +982,13 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
 	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	      if ((unsigned char)newp[j] != (index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
 	      }
 	    }
-	    memset(newp, index & 0xFF, size);
+	    memset(newp, index & 0xFF, usable);
 
 	    /* Remember region */
 	    trace->blocks[index] = newp;
@@ -671,7 +1000,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    /* Remove region from list and call student's free function */
 	    p = trace->blocks[index];
 	    remove_range(ranges, p);
-	    mm_free(p);
+	    mm_free_trace(p, size);
 	    break;
 
 	default:
@@ -680,19 +1009,118 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 
     }
 
+    /* Requests that cannot fit in the address space must fail */
+    if (!eval_mm_huge(tracenum, trace->num_ops))
+	return 0;
+
     /* As far as we know, this is a valid malloc package */
     return 1;
 }
 
+/*
+ * eval_mm_huge - Check that requests near SIZE_MAX fail rather than 
+ *    wrap to a small block. The realloc is of a block at the mmap 
+ *    threshold (-m), so that both the heap and the mapped paths are 
+ *    covered when one is set.
+ */
+static int eval_mm_huge(int tracenum, int opnum)
+{
+    size_t huge = SIZE_MAX - 100;
+    size_t size = mm_opts.mmap_threshold ? mm_opts.mmap_threshold : 64;
+    char *p;
+
+    if (mm_malloc(huge) != NULL) {
+	malloc_error(tracenum, opnum, "mm_malloc of SIZE_MAX - 100 bytes did not fail");
+	return 0;
+    }
+    if (mm_calloc(1, huge) != NULL || mm_calloc(2, huge / 2 + 1) != NULL) {
+	malloc_error(tracenum, opnum, "mm_calloc of SIZE_MAX - 100 bytes did not fail");
+	return 0;
+    }
+    if (mm_memalign(4096, huge) != NULL) {
+	malloc_error(tracenum, opnum, "mm_memalign of SIZE_MAX - 100 bytes did not fail");
+	return 0;
+    }
+    if ((p = mm_malloc(size)) == NULL) {
+	malloc_error(tracenum, opnum, "mm_malloc failed.");
+	return 0;
+    }
+    if (mm_realloc(p, huge) != NULL) {
+	malloc_error(tracenum, opnum, "mm_realloc to SIZE_MAX - 100 bytes did not fail");
+	return 0;
+    }
+    mm_free(p);
+    return 1;
+}
+
+/*
+ * checked_size - returns the bytes of block p that the validity check 
+ *    covers: size, or with -s the usable size of the block, which must be
+ *    at least size; returns 0 after reporting a usable size that is short
+ */
+static int checked_size(char *p, int size, int tracenum, int opnum)
+{
+    size_t usable;
+
+    if (!sized)
+	return size;
+    if ((usable = mm_usable_size(p)) < (size_t)size) {
+	sprintf(msg, "mm_usable_size (%lu) below the requested size (%d)", 
+		(unsigned long)usable, size);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
+    }
+    return (int)usable;
+}
+
+/*
+ * mm_alloc - allocates the block of an ALLOC, MEMALIGN or CALLOC request 
+ *    with mm
+ */
+static void *mm_alloc(traceop_t *op)
+{
+    if (op->type == MEMALIGN)
+	return mm_memalign(op->align, op->size);
+    if (op->type == CALLOC)
+	return mm_calloc(1, op->size);
+    return mm_malloc(op->size);
+}
+
+/*
+ * libc_alloc - allocates the block of an ALLOC, MEMALIGN or CALLOC request
+ *    with libc, whose aligned_alloc wants the size a multiple of the 
+ *    alignment
+ */
+static void *libc_alloc(traceop_t *op)
+{
+    if (op->type == MEMALIGN)
+	return aligned_alloc(op->align, (op->size + op->align - 1) / op->align * op->align);
+    if (op->type == CALLOC)
+	return calloc(1, op->size);
+    return malloc(op->size);
+}
+
+/*
+ * mm_free_trace - frees block p of size bytes with mm_free, or with 
+ *    mm_free_sized under -s
+ */
+static void mm_free_trace(void *p, int size)
+{
+    if (sized)
+	mm_free_sized(p, size);
+    else
+	mm_free(p);
+}
+
 /* 
  * eval_mm_util - Evaluate the space utilization of the student's package
  *   The idea is to remember the high water mark "hwm" of the heap for 
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
  *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
+ *   package on the trace. The heap can shrink when mm malloc trims it,
+ *   and blocks it maps on their own come and go, so the heap size used
+ *   is the peak of brk plus the mapped bytes, sampled after every request.
  *   
  */
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
@@ -702,6 +1130,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
     int size, newsize, oldsize;
     int max_total_size = 0;
     int total_size = 0;
+    size_t footprint, max_footprint = 0;
     char *p;
     char *newp, *oldp;
 
@@ -714,10 +1143,12 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_alloc */
+        case MEMALIGN: /* mm_memalign */
+        case CALLOC: /* mm_calloc */
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
+	    if ((p = mm_alloc(&trace->ops[i])) == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
 	    
 	    /* Remember region and size */
@@ -760,7 +1191,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    size = trace->block_sizes[index];
 	    p = trace->blocks[index];
 	    
-	    mm_free(p);
+	    mm_free_trace(p, trace->ops[i].size);
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -772,9 +1203,12 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    app_error("Nonexistent request type in eval_mm_util");
 
         }
+
+        footprint = mem_heapsize() + mm_mapped_bytes();
+        max_footprint = (footprint > max_footprint) ? footprint : max_footprint;
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    return ((double)max_total_size / (double)max_footprint);
 }
 
 
@@ -784,7 +1218,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
+    int i, index, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
@@ -798,9 +1232,10 @@ static void eval_mm_speed(void *ptr)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
+        case MEMALIGN: /* mm_memalign */
+        case CALLOC: /* mm_calloc */
             index = trace->ops[i].index;
-            size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = mm_alloc(&trace->ops[i])) == NULL)
 		app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
@@ -817,7 +1252,7 @@ static void eval_mm_speed(void *ptr)
         case FREE: /* mm_free */
             index = trace->ops[i].index;
             block = trace->blocks[index];
-            mm_free(block);
+            mm_free_trace(block, trace->ops[i].size);
             break;
 
 	default:
@@ -825,6 +1260,627 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+/*
+ * cmp_double - qsort comparison function for doubles
+ */
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * eval_mm_latency - Time every mm malloc/free/realloc call of a trace
+ *    individually and record the median, tail percentiles and worst case.
+ *    Unlike eval_mm_speed, which reports an average over whole runs, this
+ *    exposes the per-call cost of long free-list searches.
+ */
+static void eval_mm_latency(trace_t *trace, stats_t *stats)
+{
+    int i, index, newsize;
+    char *p, *newp, *oldp, *block;
+    double *lat;
+    struct timespec t0, t1;
+
+    if ((lat = (double *)malloc(trace->num_ops * sizeof(double))) == NULL)
+	unix_error("malloc failed in eval_mm_latency");
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (mm_init() < 0) 
+	app_error("mm_init failed in eval_mm_latency");
+
+    /* Interpret and time each trace request */
+    for (i = 0;  i < trace->num_ops;  i++) {
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+        case MEMALIGN: /* mm_memalign */
+        case CALLOC: /* mm_calloc */
+            index = trace->ops[i].index;
+            if ((p = mm_alloc(&trace->ops[i])) == NULL)
+		app_error("mm_malloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+	case REALLOC: /* mm_realloc */
+	    index = trace->ops[i].index;
+            newsize = trace->ops[i].size;
+	    oldp = trace->blocks[index];
+            if ((newp = mm_realloc(oldp,newsize)) == NULL)
+		app_error("mm_realloc error in eval_mm_latency");
+            trace->blocks[index] = newp;
+            break;
+
+        case FREE: /* mm_free */
+            index = trace->ops[i].index;
+            block = trace->blocks[index];
+            mm_free_trace(block, trace->ops[i].size);
+            break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_latency");
+        }
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	lat[i] = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+    }
+
+    qsort(lat, trace->num_ops, sizeof(double), cmp_double);
+    stats->lat_p50 = lat[(int)(trace->num_ops * 0.50)];
+    stats->lat_p99 = lat[(int)(trace->num_ops * 0.99)];
+    stats->lat_p999 = lat[(int)(trace->num_ops * 0.999)];
+    stats->lat_max = lat[trace->num_ops - 1];
+    free(lat);
+}
+
+/*
+ * eval_mm_first - Runs a trace on a cold heap, one whose pages earlier 
+ *    runs touched were given back, and times mm_init, the first n ops 
+ *    and the rest apart, counting the page faults each takes. Without 
+ *    prefaulting the first ops pay for faulting the heap in as it grows;
+ *    with it (-w) mm_init pays instead.
+ */
+static void eval_mm_first(trace_t *trace, int n, stats_t *stats)
+{
+    int i, index, newsize;
+    char *p, *newp, *oldp, *block;
+    struct timespec t0, t1, t2, t3;
+    long f0, f1, f2, f3;
+
+    if (n > trace->num_ops)
+	n = trace->num_ops;
+
+    /* Reset the heap, drop the pages earlier runs touched, and init mm */
+    mem_reset_brk();
+    mem_release();
+    f0 = minor_faults();
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (mm_init() < 0) 
+	app_error("mm_init failed in eval_mm_first");
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    f1 = minor_faults();
+    t2 = t1;
+    f2 = f1;
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	if (i == n) {
+	    clock_gettime(CLOCK_MONOTONIC, &t2);
+	    f2 = minor_faults();
+	}
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+        case MEMALIGN: /* mm_memalign */
+        case CALLOC: /* mm_calloc */
+            index = trace->ops[i].index;
+            if ((p = mm_alloc(&trace->ops[i])) == NULL)
+		app_error("mm_malloc error in eval_mm_first");
+            trace->blocks[index] = p;
+            break;
+
+	case REALLOC: /* mm_realloc */
+	    index = trace->ops[i].index;
+            newsize = trace->ops[i].size;
+	    oldp = trace->blocks[index];
+            if ((newp = mm_realloc(oldp,newsize)) == NULL)
+		app_error("mm_realloc error in eval_mm_first");
+            trace->blocks[index] = newp;
+            break;
+
+        case FREE: /* mm_free */
+            index = trace->ops[i].index;
+            block = trace->blocks[index];
+            mm_free_trace(block, trace->ops[i].size);
+            break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_first");
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t3);
+    f3 = minor_faults();
+    if (n == trace->num_ops) {
+	t2 = t3;
+	f2 = f3;
+    }
+
+    stats->init_us = between(&t0, &t1) * 1e6;
+    stats->first_ns = between(&t1, &t2) * 1e9 / n;
+    stats->rest_ns = (n < trace->num_ops) ? 
+	between(&t2, &t3) * 1e9 / (trace->num_ops - n) : 0;
+    stats->init_faults = f1 - f0;
+    stats->first_faults = f2 - f1;
+    stats->rest_faults = f3 - f2;
+}
+
+/*
+ * minor_faults - returns the minor page faults the process has taken
+ */
+static long minor_faults(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_minflt;
+}
+
+/*
+ * eval_mm_rss - Runs a trace and records how much the process's resident
+ *    memory has grown by its end, once as left by mm malloc and once more
+ *    after mm_trim, along with the peak heap size for comparison. The
+ *    baseline is taken on an empty heap whose old pages were released, 
+ *    so pages touched by earlier runs do not count.
+ */
+static void eval_mm_rss(trace_t *trace, stats_t *stats)
+{
+    int i, index, size, newsize;
+    char *p, *newp, *oldp, *block;
+    size_t footprint, max_footprint = 0;
+    long base;
+
+    /* Reset the heap, drop the pages earlier runs touched, and init mm */
+    mem_reset_brk();
+    mem_release();
+    if (mm_init() < 0) 
+	app_error("mm_init failed in eval_mm_rss");
+    base = rss_kb();
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+        case MEMALIGN: /* mm_memalign */
+        case CALLOC: /* mm_calloc */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_alloc(&trace->ops[i])) == NULL)
+		app_error("mm_malloc error in eval_mm_rss");
+            memset(p, 0, size);     /* a program touches what it allocates */
+            trace->blocks[index] = p;
+            break;
+
+	case REALLOC: /* mm_realloc */
+	    index = trace->ops[i].index;
+            newsize = trace->ops[i].size;
+	    oldp = trace->blocks[index];
+            if ((newp = mm_realloc(oldp,newsize)) == NULL)
+		app_error("mm_realloc error in eval_mm_rss");
+            memset(newp, 0, newsize);
+            trace->blocks[index] = newp;
+            break;
+
+        case FREE: /* mm_free */
+            index = trace->ops[i].index;
+            block = trace->blocks[index];
+            mm_free_trace(block, trace->ops[i].size);
+            break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_rss");
+        }
+
+        footprint = mem_heapsize() + mm_mapped_bytes();
+        max_footprint = (footprint > max_footprint) ? footprint : max_footprint;
+    }
+
+    stats->rss_heap = max_footprint / 1024.0;
+    stats->rss_end = rss_kb() - base;
+    mm_trim();
+    stats->rss_trim = rss_kb() - base;
+}
+
+/*
+ * eval_mm_defer - Measures the util and throughput of a trace twice, with
+ *    eager and with deferred coalescing, leaving mm_opts as it found it
+ */
+static void eval_mm_defer(trace_t *trace, int tracenum, speed_t *speed, 
+                          stats_t *stats)
+{
+    int saved = mm_opts.defer_coalesce;
+    range_t *ranges = NULL;
+    int mode;
+
+    for (mode = 0; mode < 2; mode++) {
+	mm_opts.defer_coalesce = mode;
+	stats->defer_util[mode] = eval_mm_util(trace, tracenum, &ranges);
+	stats->defer_secs[mode] = fsecs(eval_mm_speed, speed);
+    }
+    mm_opts.defer_coalesce = saved;
+}
+
+/*
+ * eval_mm_fits - Measures the util and throughput of a trace under each
+ *    placement policy, leaving mm_opts as it found it
+ */
+static void eval_mm_fits(trace_t *trace, int tracenum, speed_t *speed, 
+                         stats_t *stats)
+{
+    int saved = mm_opts.placement;
+    range_t *ranges = NULL;
+    int fit;
+
+    for (fit = 0; fit < MM_NUM_FITS; fit++) {
+	mm_opts.placement = fit;
+	stats->fit_util[fit] = eval_mm_util(trace, tracenum, &ranges);
+	stats->fit_secs[fit] = fsecs(eval_mm_speed, speed);
+    }
+    mm_opts.placement = saved;
+}
+
+/*
+ * refit_block - frees blocks X, S and Y of one size class, with S too 
+ *    small for a request, takes X back for the request, frees it again 
+ *    and returns the offset of the block the same request then gets 
+ *    under placement policy fit. First fit takes X from the head of the
+ *    list again; next fit resumes at S and takes Y.
+ */
+static void *refit_block(int fit)
+{
+    mm_opts_t saved = mm_opts;
+    char *x, *s, *y, *p;
+
+    mm_opts.engine = MM_ENGINE_SEGLIST;
+    mm_opts.thread_safe = 0;
+    mm_opts.mmap_threshold = 0;
+    mm_opts.defer_coalesce = 0;
+    mm_opts.placement = fit;
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in refit_block");
+
+    /* allocated guards between the blocks keep them from coalescing */
+    x = mm_malloc(800);
+    mm_malloc(200);
+    s = mm_malloc(600);
+    mm_malloc(200);
+    y = mm_malloc(800);
+    mm_malloc(200);
+    if (x == NULL || s == NULL || y == NULL)
+	app_error("mm_malloc failed in refit_block");
+    mm_free(y);
+    mm_free(s);
+    mm_free(x);
+    mm_free(mm_malloc(800));
+    p = mm_malloc(800);
+
+    mm_opts = saved;
+    return (void *)(p - (char *)mem_heap_lo());
+}
+
+/*
+ * eval_batch_speed - allocates BATCH_OBJS objects in groups of n, then 
+ *    frees them group by group, either a call per object or a batch call
+ *    per group
+ */
+static void eval_batch_speed(void *ptr)
+{
+    static void *objs[BATCH_OBJS];
+    batch_t *b = ptr;
+    size_t i, j, n;
+
+    mem_reset_brk();
+    if (mm_init() < 0) 
+	app_error("mm_init failed in eval_batch_speed");
+
+    for (i = 0; i < BATCH_OBJS; i += n) {
+	n = (BATCH_OBJS - i < b->n) ? BATCH_OBJS - i : b->n;
+	if (b->batch) {
+	    if (mm_malloc_batch(b->size, n, objs + i) < n)
+		app_error("mm_malloc_batch error in eval_batch_speed");
+	}
+	else {
+	    for (j = i; j < i + n; j++)
+		if ((objs[j] = mm_malloc(b->size)) == NULL)
+		    app_error("mm_malloc error in eval_batch_speed");
+	}
+    }
+    for (i = 0; i < BATCH_OBJS; i += n) {
+	n = (BATCH_OBJS - i < b->n) ? BATCH_OBJS - i : b->n;
+	if (b->batch)
+	    mm_free_batch(objs + i, n);
+	else {
+	    for (j = i; j < i + n; j++)
+		mm_free(objs[j]);
+	}
+    }
+}
+
+/*
+ * eval_heap_trace - Replays a trace on an mm heap of its own, which the 
+ *    thread running it creates and destroys, checking that realloc keeps
+ *    the data of the block as eval_mm_valid does. A calloc request is a
+ *    malloc here, as heaps have no calloc of their own. Utilization is 
+ *    the peak payload over the peak size of the heap.
+ */
+static void *eval_heap_trace(void *ptr)
+{
+    heap_run_t *run = (heap_run_t *)ptr;
+    trace_t *trace = run->trace;
+    traceop_t *op;
+    struct timespec start;
+    mm_heap_t *heap;
+    int i, j, index, size, oldsize;
+    int total_size = 0, max_total_size = 0;
+    size_t heapsize, max_heapsize = 0;
+    char *p;
+
+    run->valid = 0;
+    run->badop = 0;
+    if ((heap = mm_heap_create(0)) == NULL) {
+	run->why = "mm_heap_create failed.";
+	return NULL;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0;  i < trace->num_ops;  i++) {
+	op = &trace->ops[i];
+	index = op->index;
+	size = op->size;
+	run->badop = i;
+
+        switch (op->type) {
+
+        case ALLOC: /* mm_heap_malloc */
+        case MEMALIGN: /* mm_heap_memalign */
+        case CALLOC: /* mm_heap_malloc */
+	    p = (op->type == MEMALIGN) ? mm_heap_memalign(heap, op->align, size)
+	                               : mm_heap_malloc(heap, size);
+	    if (p == NULL) {
+		run->why = "mm_heap_malloc failed.";
+		goto out;
+	    }
+	    if (!IS_ALIGNED(p) || 
+		(op->type == MEMALIGN && (uintptr_t)p % op->align != 0)) {
+		run->why = "Payload address is not aligned.";
+		goto out;
+	    }
+	    memset(p, index & 0xFF, size);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    total_size += size;
+	    break;
+
+        case REALLOC: /* mm_heap_realloc */
+	    if ((p = mm_heap_realloc(heap, trace->blocks[index], size)) == NULL) {
+		run->why = "mm_heap_realloc failed.";
+		goto out;
+	    }
+	    oldsize = trace->block_sizes[index];
+	    for (j = 0; j < size && j < oldsize; j++) {
+		if ((unsigned char)p[j] != (index & 0xFF)) {
+		    run->why = "mm_heap_realloc did not preserve the data from old block";
+		    goto out;
+		}
+	    }
+	    memset(p, index & 0xFF, size);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    total_size += size - oldsize;
+	    break;
+
+        case FREE: /* mm_heap_free */
+	    mm_heap_free(heap, trace->blocks[index]);
+	    total_size -= trace->block_sizes[index];
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_heap_trace");
+        }
+
+	max_total_size = (total_size > max_total_size) ?
+	    total_size : max_total_size;
+	heapsize = mm_heap_size(heap);
+	max_heapsize = (heapsize > max_heapsize) ? heapsize : max_heapsize;
+    }
+    run->secs = elapsed(&start);
+    run->util = (double)max_total_size / (double)max_heapsize;
+    run->valid = 1;
+
+ out:
+    mm_heap_destroy(heap);
+    return NULL;
+}
+
+/*
+ * eval_heaps - Replays the n traces on heaps of their own, first one 
+ *    after another in this thread, then all at once with a thread each,
+ *    and prints the util and time of each trace and the wall time of both
+ *    runs. Both runs use the options of the last mm_init.
+ */
+static void eval_heaps(char *tracedir, char **tracefiles, int n)
+{
+    heap_run_t *runs;
+    pthread_t *threads;
+    struct timespec start;
+    double serial_secs, concurrent_secs, secs = 0;
+    int i, valid = 1;
+
+    if ((runs = calloc(n, sizeof(heap_run_t))) == NULL ||
+	(threads = calloc(n, sizeof(pthread_t))) == NULL)
+	unix_error("calloc in eval_heaps failed");
+    for (i = 0; i < n; i++) {
+	runs[i].trace = read_trace(tracedir, tracefiles[i]);
+	runs[i].tracenum = i;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < n; i++)
+	eval_heap_trace(&runs[i]);
+    serial_secs = elapsed(&start);
+
+    printf("%5s%7s%8s%10s\n", "trace", "valid", "util", "secs");
+    for (i = 0; i < n; i++) {
+	if (runs[i].valid) {
+	    printf("%2d%8s%7.0f%%%10.6f\n", 
+		   i, "yes", runs[i].util * 100.0, runs[i].secs);
+	    secs += runs[i].secs;
+	}
+	else {
+	    printf("%2d%8s%8s%10s\n", i, "no", "-", "-");
+	    valid = 0;
+	}
+    }
+    printf("%-5s%25.6f\n", "Total", secs);
+    for (i = 0; i < n; i++)
+	if (!runs[i].valid)
+	    malloc_error(i, runs[i].badop, runs[i].why);
+
+    if (valid) {
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < n; i++)
+	    if (pthread_create(&threads[i], NULL, eval_heap_trace, &runs[i]) != 0)
+		unix_error("pthread_create in eval_heaps failed");
+	for (i = 0; i < n; i++)
+	    pthread_join(threads[i], NULL);
+	concurrent_secs = elapsed(&start);
+
+	for (i = 0; i < n; i++)
+	    if (!runs[i].valid)
+		malloc_error(i, runs[i].badop, runs[i].why);
+	printf("Wall time: %.6f secs one after another, %.6f secs at once (%.2fx)\n",
+	       serial_secs, concurrent_secs, serial_secs / concurrent_secs);
+    }
+
+    for (i = 0; i < n; i++)
+	free_trace(runs[i].trace);
+    free(threads);
+    free(runs);
+}
+
+/*
+ * elapsed - seconds from start to now
+ */
+static double elapsed(const struct timespec *start)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return between(start, &end);
+}
+
+/*
+ * between - seconds from start to end
+ */
+static double between(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * rss_kb - returns the resident set size of the process in KB
+ */
+static long rss_kb(void)
+{
+    FILE *fp;
+    long size, resident = 0;
+
+    if ((fp = fopen("/proc/self/statm", "r")) == NULL)
+	return 0;
+    if (fscanf(fp, "%ld %ld", &size, &resident) != 2)
+	resident = 0;
+    fclose(fp);
+    return resident * (long)(mem_pagesize() / 1024);
+}
+
+/*
+ * tlb_open - opens counters of the dTLB load and store misses of this 
+ *    process in user mode. Either may be missing, as they are on CPUs
+ *    without such events and where perf_event_open is not allowed, such
+ *    as in many containers; the report then shows huge pages only.
+ */
+static void tlb_open(void)
+{
+    struct perf_event_attr attr;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CACHE_DTLB | 
+	    ((i == 0 ? PERF_COUNT_HW_CACHE_OP_READ : PERF_COUNT_HW_CACHE_OP_WRITE) << 8) |
+	    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	tlb_fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    if (tlb_fds[0] < 0 && tlb_fds[1] < 0)
+	printf("No dTLB counters (%s); reporting huge pages only\n", strerror(errno));
+}
+
+/*
+ * eval_mm_tlb - Runs a trace once, as eval_mm_speed does, on a heap whose
+ *    old pages were released, counting the dTLB misses of the run and 
+ *    recording the huge pages the process has mapped at its end
+ */
+static void eval_mm_tlb(speed_t *speed, stats_t *stats)
+{
+    long long count;
+    double *misses[2] = {&stats->tlb_loads, &stats->tlb_stores};
+    int i;
+
+    mem_reset_brk();
+    mem_release();
+    for (i = 0; i < 2; i++) {
+	if (tlb_fds[i] >= 0) {
+	    ioctl(tlb_fds[i], PERF_EVENT_IOC_RESET, 0);
+	    ioctl(tlb_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+    }
+    eval_mm_speed(speed);
+    for (i = 0; i < 2; i++) {
+	*misses[i] = -1;
+	if (tlb_fds[i] >= 0) {
+	    ioctl(tlb_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+	    if (read(tlb_fds[i], &count, sizeof(count)) == sizeof(count))
+		*misses[i] = count;
+	}
+    }
+    stats->huge_kb = huge_kb();
+}
+
+/*
+ * huge_kb - returns the KB of transparent huge pages the process has
+ *    mapped, or 0 if the kernel does not say
+ */
+static long huge_kb(void)
+{
+    FILE *fp;
+    char line[MAXLINE];
+    long kb = 0;
+
+    if ((fp = fopen("/proc/self/smaps_rollup", "r")) == NULL)
+	return 0;
+    while (fgets(line, MAXLINE, fp) != NULL)
+	if (sscanf(line, "AnonHugePages: %ld", &kb) == 1)
+	    break;
+    fclose(fp);
+    return kb;
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -840,7 +1896,9 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* malloc */
-	    if ((p = malloc(trace->ops[i].size)) == NULL) {
+        case MEMALIGN: /* aligned_alloc */
+        case CALLOC: /* calloc */
+	    if ((p = libc_alloc(&trace->ops[i])) == NULL) {
 		malloc_error(tracenum, i, "libc malloc failed");
 		unix_error("System message");
 	    }
@@ -877,16 +1935,17 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 static void eval_libc_speed(void *ptr)
 {
     int i;
-    int index, size, newsize;
+    int index, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
         case ALLOC: /* malloc */
+        case MEMALIGN: /* aligned_alloc */
+        case CALLOC: /* calloc */
 	    index = trace->ops[i].index;
-	    size = trace->ops[i].size;
-	    if ((p = malloc(size)) == NULL)
+	    if ((p = libc_alloc(&trace->ops[i])) == NULL)
 		unix_error("malloc failed in eval_libc_speed");
 	    trace->blocks[index] = p;
 	    break;
@@ -972,6 +2031,232 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printlatency - prints the per-operation latency distribution of mm malloc
+ */
+static void printlatency(int n, stats_t *stats) 
+{
+    int i;
+    double worst = 0;
+
+    printf("%5s%9s%9s%9s%9s\n", "trace", "p50", "p99", "p99.9", "max");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%2d%12.0f%9.0f%9.0f%9.0f\n", 
+		   i,
+		   stats[i].lat_p50,
+		   stats[i].lat_p99,
+		   stats[i].lat_p999,
+		   stats[i].lat_max);
+	    worst = (stats[i].lat_max > worst) ? stats[i].lat_max : worst;
+	}
+	else {
+	    printf("%2d%12s%9s%9s%9s\n", i, "-", "-", "-", "-");
+	}
+    }
+    printf("%-32s%9.0f\n", "Worst", worst);
+}
+
+/*
+ * printfirst - prints, for each trace run on a cold heap, the time and
+ *    page faults of mm_init, of the first ops and of the rest
+ */
+static void printfirst(int n, int first, stats_t *stats) 
+{
+    int i;
+
+    printf("%5s%10s%8s%10s%8s%10s%8s\n", 
+	   "trace", "init us", "faults", "first ns", "faults", "rest ns", "faults");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%2d%13.1f%8.0f%10.0f%8.0f%10.0f%8.0f\n", 
+		   i,
+		   stats[i].init_us, stats[i].init_faults,
+		   stats[i].first_ns, stats[i].first_faults,
+		   stats[i].rest_ns, stats[i].rest_faults);
+	}
+	else {
+	    printf("%2d%13s%8s%10s%8s%10s%8s\n", i, "-", "-", "-", "-", "-", "-");
+	}
+    }
+}
+
+/*
+ * printrss - prints the peak heap size of mm malloc for each trace, and the
+ *    growth in resident memory at the trace's end before and after mm_trim
+ */
+static void printrss(int n, stats_t *stats) 
+{
+    int i;
+
+    printf("%5s%10s%10s%10s\n", "trace", "heap", "end", "trimmed");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%2d%13.0f%10.0f%10.0f\n", 
+		   i,
+		   stats[i].rss_heap,
+		   stats[i].rss_end,
+		   stats[i].rss_trim);
+	}
+	else {
+	    printf("%2d%13s%10s%10s\n", i, "-", "-", "-");
+	}
+    }
+}
+
+/*
+ * printtlb - prints the dTLB load and store misses of mm malloc on each
+ *    trace, in all and per thousand ops, and the huge pages mapped at its
+ *    end; "-" marks a count the CPU or kernel would not give
+ */
+static void printtlb(int n, stats_t *stats) 
+{
+    int i, j;
+    double m;
+
+    printf("%5s%12s%12s%10s%10s%10s\n", "trace", "loads", "stores", 
+	   "loads/K", "stores/K", "huge KB");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid) {
+	    printf("%2d%15s%12s%10s%10s%10s\n", i, "-", "-", "-", "-", "-");
+	    continue;
+	}
+	printf("%2d", i);
+	for (j = 0; j < 2; j++) {
+	    m = (j == 0) ? stats[i].tlb_loads : stats[i].tlb_stores;
+	    if (m < 0)
+		printf("%*s", j == 0 ? 15 : 12, "-");
+	    else
+		printf("%*.0f", j == 0 ? 15 : 12, m);
+	}
+	for (j = 0; j < 2; j++) {
+	    m = (j == 0) ? stats[i].tlb_loads : stats[i].tlb_stores;
+	    if (m < 0)
+		printf("%10s", "-");
+	    else
+		printf("%10.1f", m / stats[i].ops * 1000.0);
+	}
+	printf("%10.0f\n", stats[i].huge_kb);
+    }
+}
+
+/*
+ * printdefer - prints the util and throughput of mm malloc on each trace
+ *    with eager and with deferred coalescing
+ */
+static void printdefer(int n, stats_t *stats) 
+{
+    int i, mode;
+    double util[2] = {0, 0}, secs[2] = {0, 0}, ops = 0;
+
+    printf("%5s%10s%10s%10s%10s\n", "trace", "util", "deferred", "Kops", "deferred");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%2d%12.0f%%%9.0f%%%10.0f%10.0f\n", 
+		   i,
+		   stats[i].defer_util[0]*100.0,
+		   stats[i].defer_util[1]*100.0,
+		   (stats[i].ops/1e3)/stats[i].defer_secs[0],
+		   (stats[i].ops/1e3)/stats[i].defer_secs[1]);
+	    for (mode = 0; mode < 2; mode++) {
+		util[mode] += stats[i].defer_util[mode];
+		secs[mode] += stats[i].defer_secs[mode];
+	    }
+	    ops += stats[i].ops;
+	}
+	else {
+	    printf("%2d%13s%10s%10s%10s\n", i, "-", "-", "-", "-");
+	}
+    }
+    printf("%-7s%7.0f%%%9.0f%%%10.0f%10.0f\n", "Total",
+	   (util[0]/n)*100.0, (util[1]/n)*100.0,
+	   (ops/1e3)/secs[0], (ops/1e3)/secs[1]);
+}
+
+/*
+ * printfits - prints the util and throughput of mm malloc on each trace
+ *    under each placement policy
+ */
+static void printfits(int n, stats_t *stats) 
+{
+    static const char *names[MM_NUM_FITS] = {"first", "next", "best", "good"};
+    double util[MM_NUM_FITS] = {0}, secs[MM_NUM_FITS] = {0}, ops = 0;
+    int i, fit;
+
+    printf("%5s", "trace");
+    for (fit = 0; fit < MM_NUM_FITS; fit++)
+	printf("%15s", names[fit]);
+    printf("\n");
+    for (i=0; i < n; i++) {
+	printf("%2d   ", i);
+	for (fit = 0; fit < MM_NUM_FITS; fit++) {
+	    if (stats[i].valid) {
+		printf("%6.0f%% /%6.0f", stats[i].fit_util[fit]*100.0,
+		       (stats[i].ops/1e3)/stats[i].fit_secs[fit]);
+		util[fit] += stats[i].fit_util[fit];
+		secs[fit] += stats[i].fit_secs[fit];
+	    }
+	    else
+		printf("%15s", "-");
+	}
+	if (stats[i].valid)
+	    ops += stats[i].ops;
+	printf("\n");
+    }
+    printf("%-5s", "Total");
+    for (fit = 0; fit < MM_NUM_FITS; fit++)
+	printf("%6.0f%% /%6.0f", (util[fit]/n)*100.0, (ops/1e3)/secs[fit]);
+    printf("\n");
+}
+
+/*
+ * printbatch - times BATCH_OBJS mallocs and frees of each of BATCH_SIZES,
+ *    in groups of n, with a call per object and with a batch call per group
+ */
+static void printbatch(size_t n) 
+{
+    static const size_t sizes[] = BATCH_SIZES;
+    batch_t b;
+    double secs[2];
+    int i;
+
+    printf("%5s%10s%10s%10s\n", "size", "per-call", "batch", "speedup");
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+	b.size = sizes[i];
+	b.n = n;
+	for (b.batch = 0; b.batch < 2; b.batch++)
+	    secs[b.batch] = fsecs(eval_batch_speed, &b);
+	printf("%5lu%10.0f%10.0f%9.2fx\n", (unsigned long)sizes[i],
+	       (2 * BATCH_OBJS / 1e3) / secs[0], (2 * BATCH_OBJS / 1e3) / secs[1],
+	       secs[0] / secs[1]);
+    }
+}
+
+/*
+ * printgrowth - prints the sbrk calls and heap high-water mark of mm 
+ *    malloc on each trace
+ */
+static void printgrowth(int n, stats_t *stats) 
+{
+    int i;
+    double sbrks = 0;
+
+    printf("%5s%10s%12s\n", "trace", "sbrks", "peak KB");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%2d%13.0f%12.1f\n", 
+		   i,
+		   stats[i].sbrks,
+		   stats[i].heap_peak / 1024.0);
+	    sbrks += stats[i].sbrks;
+	}
+	else {
+	    printf("%2d%13s%12s\n", i, "-", "-");
+	}
+    }
+    printf("%-5s%10.0f\n", "Total", sbrks);
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -1004,14 +2289,33 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvVaCdDlHLPRsTuX] [-f <file>] [-t <dir>] [-B <n>] [-e <engine>] [-c <growth>] [-m <bytes>] [-N <n>] [-p <fit>] [-r <bytes>] [-w <bytes>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-B <n>     Compare batch and per-call malloc and free, <n> objects per batch.\n");
+    fprintf(stderr, "\t-c <grow>  Grow the heap by policy <grow>: adaptive (default) or fixed.\n");
+    fprintf(stderr, "\t-C         Also run the traces at once, each on an mm heap of its own.\n");
+    fprintf(stderr, "\t-d         Run mm malloc with deferred coalescing.\n");
+    fprintf(stderr, "\t-D         Compare util and throughput of eager and deferred coalescing.\n");
+    fprintf(stderr, "\t-e <eng>   Use free-block index <eng>: seglist (default) or tlsf.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H         Report sbrk calls and heap high-water mark of each trace.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L         Report per-operation latency percentiles of mm malloc.\n");
+    fprintf(stderr, "\t-m <bytes> Give mm malloc requests of at least <bytes> a mapping of their own.\n");
+    fprintf(stderr, "\t-N <n>     Time the first <n> ops of each trace on a cold heap apart from the rest.\n");
+    fprintf(stderr, "\t-p <fit>   Place blocks by policy <fit>: first (default), next, best or good[:N].\n");
+    fprintf(stderr, "\t-P         Compare util and throughput of the placement policies.\n");
+    fprintf(stderr, "\t-r <bytes> Give free blocks of at least <bytes> back to the OS.\n");
+    fprintf(stderr, "\t-R         Report resident memory at the end of each trace.\n");
+    fprintf(stderr, "\t-s         Free with mm_free_sized, checking mm_usable_size of every block.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T         Run mm malloc in thread-safe mode with thread caches.\n");
+    fprintf(stderr, "\t-u         Back the mm heap with 2 MB huge pages, if the system has them.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
+    fprintf(stderr, "\t-w <bytes> Fault in the first <bytes> of the mm heap at mm_init.\n");
+    fprintf(stderr, "\t-X         Report dTLB misses and huge pages of each trace.\n");
 }
@@ -14,24 +14,79 @@
 #include "memlib.h"
 #include "config.h"
 
+/* Storage is made accessible this many bytes at a time as the brk rises */
+#define COMMIT_STEP (1 << 16)
+
+/* 
+ * A region of simulated VM: its own storage and brk pointer. The legacy
+ * mem_xxx functions below work on the default region made by mem_init.
+ * The storage is an anonymous mapping reserved with no access, so that
+ * a region only costs address space until its brk rises; sbrk commits 
+ * it (makes it readable and writable) a COMMIT_STEP at a time, and
+ * pages the heap gives back are returned to the OS and decommitted.
+ * With huge pages the storage is aligned to MEM_HUGE_PAGE and committed
+ * and released in whole huge pages, its grain.
+ */
+struct mem_region {
+    char *start_brk;  /* points to first byte of heap */
+    char *brk;        /* points to last byte of heap */
+    char *max_addr;   /* largest legal heap address */ 
+    char *map_end;    /* end of the reserved storage */
+    size_t grain;     /* page size of the storage */
+    int backing;      /* MEM_PAGES_xxx: how the storage is paged */
+    char *committed;  /* end of the storage sbrk has committed */
+    char *dirty;      /* end of the pages the heap may have touched */
+    char *peak_brk;   /* highest brk since the last reset */
+    size_t sbrk_calls;  /* successful sbrk calls since the last reset */
+};
+
 /* private variables */
-static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
-static char *mem_max_addr;   /* largest legal heap address */ 
+static mem_region_t mem_default;   /* the region behind mem_sbrk */
+static size_t mem_max = MAX_HEAP;  /* bytes mem_init reserves */
+static int mem_huge = 0;           /* back new regions with huge pages */
+
+static char *reserve_storage(size_t size);
+static char *reserve_aligned(size_t size, size_t align);
+static int region_init(mem_region_t *r, size_t size);
+static int region_commit(mem_region_t *r, char *end);
+
+/*
+ * mem_set_max_heap - sets the bytes the next mem_init reserves for the
+ *    default region, MAX_HEAP unless set
+ */
+void mem_set_max_heap(size_t size)
+{
+    mem_max = size;
+}
+
+/*
+ * mem_max_heap - returns the bytes mem_init reserves
+ */
+size_t mem_max_heap(void)
+{
+    return mem_max;
+}
+
+/*
+ * mem_set_hugepages - if on, regions made from now on are backed with 
+ *    huge pages: hugetlbfs pages if the system has enough set aside,
+ *    else transparent huge pages, else, failing both, base pages
+ */
+void mem_set_hugepages(int on)
+{
+    mem_huge = on;
+}
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    /* reserve the address space we will use to model the available VM */
+    if (region_init(&mem_default, mem_max) < 0) {
+	fprintf(stderr, "mem_init: mmap error\n");
 	exit(1);
     }
-
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
 }
 
 /* 
@@ -39,7 +94,7 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    munmap(mem_default.start_brk, mem_default.map_end - mem_default.start_brk);
 }
 
 /*
@@ -47,25 +102,26 @@ void mem_deinit(void)
  */
 void mem_reset_brk()
 {
-    mem_brk = mem_start_brk;
+    mem_region_reset(&mem_default);
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area. A
+ *    negative incr shrinks the heap and returns the pages above the new
+ *    brk to the OS.
  */
-void *mem_sbrk(int incr) 
+void *mem_sbrk(intptr_t incr) 
 {
-    char *old_brk = mem_brk;
+    return mem_region_sbrk(&mem_default, incr);
+}
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
-	errno = ENOMEM;
-	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
-	return (void *)-1;
-    }
-    mem_brk += incr;
-    return (void *)old_brk;
+/*
+ * mem_release - returns the pages above the brk to the OS
+ */
+void mem_release(void)
+{
+    mem_region_release(&mem_default);
 }
 
 /*
@@ -73,7 +129,7 @@ void *mem_sbrk(int incr)
  */
 void *mem_heap_lo()
 {
-    return (void *)mem_start_brk;
+    return mem_region_lo(&mem_default);
 }
 
 /* 
@@ -81,7 +137,7 @@ void *mem_heap_lo()
  */
 void *mem_heap_hi()
 {
-    return (void *)(mem_brk - 1);
+    return mem_region_hi(&mem_default);
 }
 
 /*
@@ -89,7 +145,308 @@ void *mem_heap_hi()
  */
 size_t mem_heapsize() 
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    return mem_region_size(&mem_default);
+}
+
+/*
+ * mem_sbrk_calls - returns the number of successful mem_sbrk calls since
+ *    the last reset
+ */
+size_t mem_sbrk_calls(void)
+{
+    return mem_default.sbrk_calls;
+}
+
+/*
+ * mem_heap_peak - returns the largest size in bytes the heap has had 
+ *    since the last reset
+ */
+size_t mem_heap_peak(void)
+{
+    return (size_t)(mem_default.peak_brk - mem_default.start_brk);
+}
+
+/*
+ * mem_default_region - returns the region behind the mem_xxx functions
+ */
+mem_region_t *mem_default_region(void)
+{
+    return &mem_default;
+}
+
+/*
+ * mem_region_create - makes a new, empty region of size bytes, with 
+ *    storage of its own. The region record lives in a page of its own
+ *    rather than in libc's heap, which may be this allocator. Returns 
+ *    NULL, having unmapped what it reserved, if the address space 
+ *    cannot be had.
+ */
+mem_region_t *mem_region_create(size_t size)
+{
+    mem_region_t *r;
+
+    r = mmap(NULL, mem_pagesize(), PROT_READ | PROT_WRITE, 
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (r == MAP_FAILED)
+	return NULL;
+    if (region_init(r, size) < 0) {
+	munmap(r, mem_pagesize());
+	return NULL;
+    }
+    return r;
+}
+
+/*
+ * mem_region_destroy - frees a region made by mem_region_create
+ */
+void mem_region_destroy(mem_region_t *r)
+{
+    munmap(r->start_brk, r->map_end - r->start_brk);
+    munmap(r, mem_pagesize());
+}
+
+/*
+ * mem_region_reset - reset the brk pointer of region r to make it empty
+ */
+void mem_region_reset(mem_region_t *r)
+{
+    r->brk = r->start_brk;
+    r->peak_brk = r->start_brk;
+    r->sbrk_calls = 0;
+}
+
+/* 
+ * mem_region_sbrk - mem_sbrk on region r. Growing commits the storage up
+ *    to the new brk; shrinking releases the pages above it.
+ */
+void *mem_region_sbrk(mem_region_t *r, intptr_t incr) 
+{
+    char *old_brk = r->brk;
+
+    if (incr < 0 && (size_t)-incr > (size_t)(r->brk - r->start_brk)) {
+	errno = EINVAL;
+	fprintf(stderr, "ERROR: mem_sbrk failed. Heap shrunk below its start...\n");
+	return (void *)-1;
+    }
+    if ((incr > 0 && (size_t)incr > (size_t)(r->max_addr - r->brk)) ||
+        (r->brk + incr > r->committed && region_commit(r, r->brk + incr) < 0)) {
+	errno = ENOMEM;
+	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+	return (void *)-1;
+    }
+    r->brk += incr;
+    r->sbrk_calls++;
+
+    if (incr < 0)
+        mem_region_release(r);
+    else {
+        if (r->brk > r->dirty)
+            r->dirty = r->brk;
+        if (r->brk > r->peak_brk)
+            r->peak_brk = r->brk;
+    }
+    return (void *)old_brk;
+}
+
+/*
+ * mem_region_release - returns to the OS every whole page above the brk of
+ *    region r that is committed, which covers the pages the heap has 
+ *    touched, including those left over from before the last reset, and 
+ *    the ones prefaulted, and decommits them
+ */
+void mem_region_release(mem_region_t *r)
+{
+    size_t page = r->grain;
+    char *lo = r->start_brk + ((r->brk - r->start_brk + page - 1) & ~(page - 1));
+
+    if (r->committed > lo) {
+        madvise(lo, r->committed - lo, MADV_DONTNEED);
+        mprotect(lo, r->committed - lo, PROT_NONE);
+        r->committed = lo;
+    }
+    if (r->dirty > lo)
+        r->dirty = lo;
+}
+
+/*
+ * mem_region_lo - return address of the first byte of region r
+ */
+void *mem_region_lo(mem_region_t *r)
+{
+    return (void *)r->start_brk;
+}
+
+/* 
+ * mem_region_hi - return address of the last byte in use in region r
+ */
+void *mem_region_hi(mem_region_t *r)
+{
+    return (void *)(r->brk - 1);
+}
+
+/*
+ * mem_region_size - returns the bytes in use in region r
+ */
+size_t mem_region_size(mem_region_t *r)
+{
+    return (size_t)(r->brk - r->start_brk);
+}
+
+/*
+ * mem_region_capacity - returns the bytes region r can grow to
+ */
+size_t mem_region_capacity(mem_region_t *r)
+{
+    return (size_t)(r->max_addr - r->start_brk);
+}
+
+/*
+ * mem_region_prefault - commits the first size bytes of region r's storage
+ *    (or all of it, if less) and faults their pages in, so that the brk 
+ *    can rise that far without a page fault. The pages keep what they 
+ *    hold. Returns -1 if the OS refuses to commit them.
+ */
+int mem_region_prefault(mem_region_t *r, size_t size)
+{
+    char *end = (size < mem_region_capacity(r)) ? r->start_brk + size : r->max_addr;
+    volatile char *p;
+
+    if (end > r->committed && region_commit(r, end) < 0)
+        return -1;
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(r->start_brk, end - r->start_brk, MADV_POPULATE_WRITE) == 0)
+        return 0;
+#endif
+    /* kernels before 5.14 lack MADV_POPULATE_WRITE: write each page */
+    for (p = r->start_brk; p < end; p += r->grain)
+        *p = *p;
+    return 0;
+}
+
+/*
+ * mem_region_pagesize - returns the page size of region r's storage: the
+ *    huge page size if it is backed by huge pages, else the base one
+ */
+size_t mem_region_pagesize(mem_region_t *r)
+{
+    return r->grain;
+}
+
+/*
+ * mem_region_backing - returns how region r's storage is paged, as one 
+ *    of the MEM_PAGES_xxx values
+ */
+int mem_region_backing(mem_region_t *r)
+{
+    return r->backing;
+}
+
+/*
+ * mem_region_zero - returns the address from which the storage of region r
+ *    is known to be zero: nothing past it has been touched since it was 
+ *    mapped or released
+ */
+void *mem_region_zero(mem_region_t *r)
+{
+    return (void *)r->dirty;
+}
+
+/*
+ * reserve_storage - reserves size bytes of anonymous, page-aligned address
+ *    space with no access, which costs no memory until it is committed;
+ *    returns MAP_FAILED if the address space cannot be had
+ */
+static char *reserve_storage(size_t size)
+{
+    return mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+}
+
+/*
+ * reserve_aligned - reserves size bytes of address space aligned to align,
+ *    a multiple of the page size, by reserving align more and unmapping
+ *    the ends
+ */
+static char *reserve_aligned(size_t size, size_t align)
+{
+    char *p, *start;
+
+    if (size > SIZE_MAX - align ||
+        (p = reserve_storage(size + align)) == MAP_FAILED)
+        return MAP_FAILED;
+    start = (char *)(((uintptr_t)p + align - 1) & ~(uintptr_t)(align - 1));
+    if (start > p)
+        munmap(p, start - p);
+    munmap(start + size, (p + align) - start);
+    return start;
+}
+
+/*
+ * region_init - makes r an empty region over size bytes of storage of its
+ *    own, none of them committed. With huge pages the storage is a 
+ *    MAP_HUGETLB mapping if the system's pool can reserve it, else an 
+ *    aligned reservation advised to take transparent huge pages; if 
+ *    neither is available the region falls back to base pages. Returns
+ *    -1 if no storage can be reserved.
+ */
+static int region_init(mem_region_t *r, size_t size)
+{
+    size_t len = (size + MEM_HUGE_PAGE - 1) & ~(size_t)(MEM_HUGE_PAGE - 1);
+    char *start = MAP_FAILED;
+
+    if (size > SIZE_MAX - MEM_HUGE_PAGE)   /* len would wrap */
+        return -1;
+    r->backing = MEM_PAGES_BASE;
+    if (!mem_huge) {
+        len = size;
+        if ((start = reserve_storage(len)) == MAP_FAILED)
+            return -1;
+    }
+#ifdef MAP_HUGETLB
+    if (start == MAP_FAILED) {
+        start = mmap(NULL, len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (start != MAP_FAILED)
+            r->backing = MEM_PAGES_HUGETLB;
+    }
+#endif
+    if (start == MAP_FAILED) {
+        if ((start = reserve_aligned(len, MEM_HUGE_PAGE)) == MAP_FAILED)
+            return -1;
+#ifdef MADV_HUGEPAGE
+        if (madvise(start, len, MADV_HUGEPAGE) == 0)
+            r->backing = MEM_PAGES_THP;
+#endif
+    }
+    r->grain = (r->backing == MEM_PAGES_BASE) ? mem_pagesize() : MEM_HUGE_PAGE;
+
+    r->start_brk = start;
+    r->map_end = start + len;
+    r->max_addr = start + size;   /* max legal heap address */
+    r->brk = start;               /* heap is empty initially */
+    r->committed = start;
+    r->dirty = start;
+    r->peak_brk = start;
+    r->sbrk_calls = 0;
+    return 0;
+}
+
+/*
+ * region_commit - commits the storage of region r up to at least end, in
+ *    whole COMMIT_STEPs, or huge pages, from the start of the region; 
+ *    returns -1 if the OS refuses, as it can when memory is overcommitted
+ *    strictly
+ */
+static int region_commit(mem_region_t *r, char *end)
+{
+    size_t unit = (r->grain > COMMIT_STEP) ? r->grain : COMMIT_STEP;
+    size_t step = ((size_t)(end - r->start_brk) + unit - 1) & ~(unit - 1);
+    char *new_end = r->start_brk + step;
+
+    if (new_end > r->map_end)
+        new_end = r->map_end;
+    if (mprotect(r->committed, new_end - r->committed, PROT_READ | PROT_WRITE) < 0)
+        return -1;
+    r->committed = new_end;
+    return 0;
 }
 
 /*
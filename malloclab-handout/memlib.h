@@ -1,11 +1,49 @@
 #include <unistd.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 void mem_init(void);               
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
 void mem_reset_brk(void); 
+void mem_release(void);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
+size_t mem_sbrk_calls(void);
+size_t mem_heap_peak(void);
+void mem_set_max_heap(size_t size);
+size_t mem_max_heap(void);
+void mem_set_hugepages(int on);
+
+/* Independent regions of simulated VM, each with its own brk */
+typedef struct mem_region mem_region_t;
+
+/* How a region's storage is paged */
+#define MEM_PAGES_BASE 0        /* the system's base pages */
+#define MEM_PAGES_THP 1         /* transparent huge pages, by MADV_HUGEPAGE */
+#define MEM_PAGES_HUGETLB 2     /* hugetlbfs pages, by MAP_HUGETLB */
+#define MEM_HUGE_PAGE (1 << 21) /* bytes per huge page */
+
+mem_region_t *mem_default_region(void);
+mem_region_t *mem_region_create(size_t size);
+void mem_region_destroy(mem_region_t *r);
+void mem_region_reset(mem_region_t *r);
+void *mem_region_sbrk(mem_region_t *r, intptr_t incr);
+void mem_region_release(mem_region_t *r);
+void *mem_region_lo(mem_region_t *r);
+void *mem_region_hi(mem_region_t *r);
+size_t mem_region_size(mem_region_t *r);
+size_t mem_region_capacity(mem_region_t *r);
+int mem_region_prefault(mem_region_t *r, size_t size);
+size_t mem_region_pagesize(mem_region_t *r);
+int mem_region_backing(mem_region_t *r);
+void *mem_region_zero(mem_region_t *r);
 
+#ifdef __cplusplus
+}
+#endif
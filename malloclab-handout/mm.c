@@ -3,79 +3,498 @@
  * @author Jian Ying (Jane) Lu
  * @date 12/8/2015
  * Assignment: Dynamic Storage Allocator Lab - Malloc  
- * @brief: implements an explicit free list (doubly linked) and first-fit search algorithm 
+ * @brief: implements segregated explicit free lists (doubly linked) with first-fit search,
+ *         and a red-black tree with best-fit search for large free blocks
  * @details: 
  *      * MALLOC: A dynamic memory allocator that maintains an area of a process's virtual 
- *      * memory known as the heap. In this approach, blocks are allocated by traversing 
- *      * an explicit, doubly linked list consisted of only free blocks to optimize search time. 
- *      * The first free block that will accomodate the requested size is chosen to be allocated.
+ *      * memory known as the heap. In this approach, free blocks are kept in an array of
+ *      * explicit, doubly linked lists, one per power-of-two size class. A request starts 
+ *      * at its own size class and takes the first block that will accomodate it, moving
+ *      * up to the larger classes only when its own class has no fit. Free blocks of 
+ *      * TREE_MIN bytes and up are kept instead in a red-black tree ordered by size,
+ *      * whose nodes live inside the free blocks; blocks of a size already in the 
+ *      * tree are chained behind its node. Requests the lists cannot serve take the
+ *      * best fit from the tree in O(log n). Large blocks are carved from the back 
+ *      * of a free block and small ones from the front, so blocks of different 
+ *      * sizes do not interleave.
  *      *
- *      * FREE: When the program frees a block, the explicit free list will add that 
- *      * block to the head of its list using doubly linked list node insertion methods.
+ *      * FREE: When the program frees a block, it is added to the head of the list for 
+ *      * its size class using doubly linked list node insertion methods.
  *      *
- *      * BLOCKS: The heap is 8-byte aligned. Each block begins with a header and ends
- *      * with a footer that holds information on the size of the block and if it is free.
- *      * To implement an explicit free list, each block also holds the address of the 
+ *      * BLOCKS: The heap is 16-byte aligned and block sizes are multiples of 16. Each
+ *      * block begins with a 4-byte header that holds the size of the block, whether 
+ *      * it is allocated, and whether the block before it is allocated. Only free 
+ *      * blocks end with a footer, which coalesce needs to find the start of a free 
+ *      * predecessor; allocated blocks give that word to the payload. To implement an
+ *      * explicit free list, each block also holds the pointer-sized addresses of the
  *      * next and previous free block if it is free. 
  *      * 
  *      *      free block: [header|previous_free_block|next_free_block|some_data|footer]
- *      * allocated block: [header|-------------------some_data-----------------|footer]
+ *      *       tree node: [header|prev|next|left|right|parent|color|some_data|footer]
+ *      * allocated block: [header|-------------------some_data-----------------------]
  *      *           
- *      * O(K) time, where k is the number of free blocks in the free list.
+ *      * O(K) time, where k is the number of free blocks in the request's size class.
+ *      *
+ *      * ENGINES: The free-block index behind find_fit is pluggable and chosen by
+ *      * mm_opts.engine at mm_init. MM_ENGINE_SEGLIST is the segregated list search
+ *      * described above. MM_ENGINE_TLSF is a two-level segregated fit index: a
+ *      * first-level bitmap of power-of-two ranges, each split linearly into 16
+ *      * second-level bins with their own bitmap. Insert, remove and lookup are
+ *      * a handful of find-first-set instructions, so malloc and free run in O(1)
+ *      * time independent of the number of free blocks.
+ *      *
+ *      * SLABS: Requests of up to SLAB_MAX bytes never reach the free-block index.
+ *      * Each small size class owns runs: RUN_SIZE heap blocks carved into equal
+ *      * slots with no per-slot header. A run keeps its class and free slots in 
+ *      * a header at its start. The heap is cut into RUN_SIZE granules and a 
+ *      * table records the run, if any, that starts in each granule; since runs
+ *      * are RUN_SIZE long, a slot lies in the run starting in its own granule 
+ *      * or the one before, so mm_free finds it in two lookups. Malloc pops a 
+ *      * slot from the class's first run with room; free pushes it back and 
+ *      * returns an empty run to the heap.
+ *      *
+ *      * THREADS: With mm_opts.thread_safe set, each thread keeps a cache of 
+ *      * freed blocks of up to TCACHE_MAX usable bytes, binned by usable size.
+ *      * Malloc pops from the thread's bin and free pushes onto it without any 
+ *      * lock; an empty bin refills TCACHE_BATCH blocks and a full one spills 
+ *      * half its blocks, each under a single lock acquisition. A thread's cache
+ *      * is flushed when it exits.
+ *      *
+ *      * ARENAS: The heap is split into up to MM_MAX_ARENAS arenas, each a full 
+ *      * heap (index, slab runs, lock) in a memlib region of its own. Threads 
+ *      * are handed arenas round-robin and move to the next one when they keep
+ *      * finding theirs locked. A block is freed to the arena whose region
+ *      * holds it, found by comparing its address with each region's range.
+ *      * Without thread_safe there is one arena, on the memlib heap. An arena 
+ *      * uses at most HEAP_LIMIT (4 GB) of its region, the most 4-byte headers
+ *      * can size, and maps a slab table that covers just that much.
+ *      *
+ *      * MAPPED BLOCKS: With mm_opts.mmap_threshold set, requests of at least 
+ *      * that many bytes skip the heap and get an anonymous mapping of their
+ *      * own. The mapping starts with its length, and the block header has 
+ *      * the MMAPPED bit. Free unmaps the block at once, realloc grows or
+ *      * shrinks it with mremap, and a block outside every arena is known
+ *      * to be mapped.
+ *      *
+ *      * TRIMMING: mm_trim shrinks each arena's region to just past its last
+ *      * allocated block and discards the whole pages inside every other free
+ *      * block, whose tags and links lie outside those pages. With 
+ *      * mm_opts.trim_threshold set, free also shrinks the heap whenever the
+ *      * last block grows past the threshold.
+ *      *
+ *      * GROWTH: A heap whose last block is free grows only by what a request 
+ *      * lacks. Otherwise MM_GROWTH_FIXED grows it by CHUNKSIZE, and the 
+ *      * default MM_GROWTH_ADAPTIVE by a step that doubles while extensions 
+ *      * come in quick succession and halves once they stall.
+ *      *
+ *      * DEFERRED COALESCING: With mm_opts.defer_coalesce set, free pushes a
+ *      * block of up to QUICK_MAX bytes onto a quick list of its exact size
+ *      * and leaves it tagged allocated, so nothing merges with it. Malloc
+ *      * reuses a quick block of the exact size before searching the index.
+ *      * The quick lists are swept (each block freed and coalesced for real)
+ *      * when they hold QUICK_LIMIT bytes, when find_fit fails, and by mm_trim.
+ *      *
+ *      * PLACEMENT: mm_opts.placement picks how a segregated list is searched:
+ *      * first fit, next fit (resuming at a per-list rover), best fit, or 
+ *      * good fit (the best fit among the first mm_opts.fit_scan blocks).
+ *      * The tree is always best fit, and TLSF has a placement of its own.
+ *      *
+ *      * BATCHES: mm_malloc_batch carves runs of equal blocks front to back
+ *      * from one free block per run, under one lock, and mm_free_batch 
+ *      * sorts its pointers and frees each run of neighbors as one block.
+ *      *
+ *      * SIZED FREE: mm_free_sized takes the size a block was allocated with
+ *      * and routes the block by it: sizes above SLAB_MAX skip the slot 
+ *      * lookup and, in thread-safe mode, those up to TCACHE_MAX go to their
+ *      * cache bin without the header being read. Other heap blocks are 
+ *      * still freed by their header. mm_usable_size reports a block's 
+ *      * payload including slack.
+ *      *
+ *      * ALIGNED BLOCKS: mm_memalign finds a free block holding an aligned 
+ *      * payload and splits the gap before it off as a free block. Mapped
+ *      * blocks record the padding before their header in MAP_PAD.
+ *      *
+ *      * HEAPS: mm_heap_create makes a heap of its own, an arena outside 
+ *      * the arenas array with a fresh region, and mm_heap_xxx work on it. 
+ *      * Destroying it unmaps its region and record without a walk.
+ *      *
+ *      * HUGE PAGES: When memlib backs a region with huge pages, the arena on
+ *      * it grows to the next huge page boundary each time and trims whole
+ *      * huge pages only, so that the pages it touches stay huge.
+ *      *
+ *      * PREFAULTING: With mm_opts.prefault set, arena_init has memlib commit
+ *      * and fault in that many bytes of the arena's region before the heap
+ *      * is built, so growing the heap that far takes no page faults.
+ *      *
+ *      * ZEROED BLOCKS: free blocks made from storage the heap has never 
+ *      * touched carry the ZEROED bit, which splits keep and merges drop, 
+ *      * except a heap extension merging with a ZEROED last block. mm_calloc
+ *      * only clears the link and footer words of such a block.
  * @bugs none
  * @todo none
  */
 
+#define _GNU_SOURCE     /* mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
 
 /* Basic constants and macros */
 #define WSIZE 4	/* word size (bytes) */
 #define DSIZE 8	/* doubleword size (bytes) */
 #define CHUNKSIZE 1<<12	/* initial heap size (bytes) */
 
-#define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
+/* 
+ * Adaptive growth: the step doubles when the heap grows again within 
+ * GROW_FAST mallocs and halves after GROW_STALL mallocs without growing. 
+ * It stays at least CHUNKSIZE and at most GROW_MAX or 1/GROW_SHARE of the
+ * heap, which bounds what the last step can overshoot.
+ */
+#define GROW_FAST 64
+#define GROW_STALL 1024
+#define GROW_MAX (1<<18)
+#define GROW_SHARE 64
+#define PSIZE sizeof(void *)  /* free-list link size (bytes) */
+#define MIN_BLOCK 32    /* smallest block: header, two list pointers, footer, rounded */
+#define SPLIT_BACK 96   /* blocks this big are carved from the back of a free block */
+
+/* Segregated free lists: class i holds blocks of size [2^(i+4), 2^(i+5)) */
+#define NUM_CLASSES 20
+#define MIN_CLASS_SHIFT 5
+
+/* Free blocks this big go in a size-ordered red-black tree, not the lists */
+#define TREE_MIN 1024
+
+/* Slab front end: requests up to SLAB_MAX bytes, one class per SLAB_STEP */
+#define SLAB_MAX 128
+#define SLAB_STEP ALIGNMENT
+#define SLAB_CLASSES (SLAB_MAX / SLAB_STEP)
+#define SLAB_CLASS(size) (((size) - 1) / SLAB_STEP)
+#define RUN_SIZE 1024   /* bytes per run, also the granule of slab_runs */
+
+/* 
+ * The most of its region an arena uses: 4-byte headers cannot describe a
+ * block of 4 GB, and no block outgrows the heap holding it
+ */
+#define HEAP_LIMIT ((size_t)1 << 32)
 
-/* single word (4) or double word (8) alignment */
-#define ALIGNMENT 8
+/* Thread caches: bins of usable size, one per TCACHE_STEP up to TCACHE_MAX */
+#define TCACHE_STEP ALIGNMENT
+#define TCACHE_MAX 512
+#define TCACHE_BINS (TCACHE_MAX / TCACHE_STEP)
+#define TCACHE_FILL 64      /* blocks a bin holds before it spills */
+#define TCACHE_BATCH 16     /* blocks moved per refill */
+
+/* Deferred coalescing: quick lists of one exact block size per ALIGNMENT */
+#define QUICK_MAX 4096          /* largest block freed to a quick list */
+#define QUICK_BINS (QUICK_MAX / ALIGNMENT + 1)
+#define QUICK_BIN(size) ((size) / ALIGNMENT)
+#define QUICK_LIMIT (64 * 1024) /* quick-list bytes that trigger a sweep */
+#define QUICK_WORDS ((QUICK_BINS + 63) / 64)
+
+/* Most bytes a batch malloc carves from one free block */
+#define BATCH_MAX (64 * 1024)
+
+/* A thread that finds its arena locked this many times moves to the next */
+#define ARENA_SWITCH 4
+
+/* 
+ * TLSF index: sizes below TLSF_SMALL map linearly onto first-level list 0,
+ * larger sizes onto first level floor(log2(size)) split into TLSF_SL_COUNT bins
+ */
+#define TLSF_SL_LOG2 4
+#define TLSF_SL_COUNT (1 << TLSF_SL_LOG2)
+#define TLSF_FL_SHIFT (TLSF_SL_LOG2 + 3)
+#define TLSF_SMALL (1 << TLSF_FL_SHIFT)
+#define TLSF_FL_COUNT (32 - TLSF_FL_SHIFT + 1)
 
 /* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(p) (((size_t)(p) + (ALIGNMENT-1)) & ~0x7)
+#define ALIGN(p) (((size_t)(p) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
 
-/* Pack a size and allocated bit into a word */
+/* Index of the most significant set bit of x (x > 0) */
+#define FLS(x) ((int)(8 * sizeof(long)) - 1 - __builtin_clzl(x))
+
+/* Pack a size and allocated bits into a word */
 #define PACK(size, alloc) ((size) | (alloc))
 
-/* Read and write a word at address p */
-#define GET(p) (*(int *)(p))
-#define PUT(p, val) (*(int *)(p) = (val))
+/* Header bit recording that the previous block is allocated */
+#define PREV_ALLOC 0x2
+
+/* Header bit marking a block that has an anonymous mapping to itself */
+#define MMAPPED 0x4
+
+/* 
+ * The same bit on a free heap block, which is never mapped, records that
+ * its bytes past its first FREE_LINKS and before its footer are all zero
+ */
+#define ZEROED 0x4
+
+/* Read and write a 32-bit word at address p; blocks are under 4 GB */
+#define GET(p) (*(uint32_t *)(p))
+#define PUT(p, val) (*(uint32_t *)(p) = (uint32_t)(val))
 
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p) (GET(p) & ~0x7)
 #define GET_ALLOC(p) (GET(p) & 0x1)
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC)
 
-/* Given block ptr bp, compute address of its header and footer */
+/* Set or clear the previous-allocated bit in the header at address p */
+#define SET_PREV_ALLOC(p) (PUT(p, GET(p) | PREV_ALLOC))
+#define CLR_PREV_ALLOC(p) (PUT(p, GET(p) & ~PREV_ALLOC))
+
+/* Given block ptr bp, compute address of its header and footer (free blocks only) */
 #define HDRP(bp) ((void *)(bp) - WSIZE)
 #define FTRP(bp) ((void *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
 
-/* Given block ptr bp, compute address of next and previous blocks */
+/* Given block ptr bp, compute address of next and previous blocks (free previous only) */
 #define NEXT_BLKP(bp) ((void *)(bp) + GET_SIZE(HDRP(bp)))
 #define PREV_BLKP(bp) ((void *)(bp) - GET_SIZE(HDRP(bp) - WSIZE))
 
+/* Bytes at the start of a free block that hold its free-block index links */
+#define FREE_LINKS (6 * PSIZE)
+
+/* 
+ * Tree nodes: a free block of TREE_MIN bytes or more keeps, after its list
+ * links, its children, parent and color in the size-ordered tree
+ */
+#define TREE_LEFT(bp) (*(char **)((char *)(bp) + 2 * PSIZE))
+#define TREE_RIGHT(bp) (*(char **)((char *)(bp) + 3 * PSIZE))
+#define TREE_PARENT(bp) (*(char **)((char *)(bp) + 4 * PSIZE))
+#define TREE_RED(bp) (*(long *)((char *)(bp) + 5 * PSIZE))
+
 /* Given block ptr bp, compute address of next and previous free blocks */
-#define NEXT_FREE_BLKP(bp)(*(void **)(bp + DSIZE))
+#define NEXT_FREE_BLKP(bp)(*(void **)(bp + PSIZE))
 #define PREV_FREE_BLKP(bp)(*(void **)(bp))
 
+/* 
+ * A mapped block's payload starts MAP_HDR bytes past MAP_PAD bytes of 
+ * alignment padding at the start of its mapping. The MAP_HDR bytes hold
+ * the mapping's length, the padding, and the block header just before bp.
+ */
+#define MAP_HDR ALIGNMENT
+#define MAP_LEN(bp) (*(size_t *)((char *)(bp) - MAP_HDR))
+#define MAP_PAD(bp) GET((char *)(bp) - DSIZE)
+#define MAP_START(bp) ((char *)(bp) - MAP_HDR - MAP_PAD(bp))
+
+/* Given any address p in arena a, compute the index of its granule */
+#define GRANULE(a, p) ((size_t)((char *)(p) - (a)->slab_base) / RUN_SIZE)
+
+/* 
+ * A slab run: an allocated heap block of RUN_SIZE bytes whose payload holds
+ * this header followed by equal slots of one size class. Never-used slots
+ * are handed out from unused; freed slots are kept on a list threaded 
+ * through their first word.
+ */
+typedef struct run {
+    struct run *next;       /* next run of this class with free slots */
+    struct run *prev;       /* previous run of this class with free slots */
+    void *free_slots;       /* singly linked list of freed slots */
+    char *unused;           /* first never-used slot */
+    char *end;              /* end of the last slot */
+    unsigned int cls;       /* slab size class */
+    unsigned int nfree;     /* freed plus never-used slots */
+} run_t;
+
+#define RUN_HDR ALIGN(sizeof(run_t))
+
+/* 
+ * A thread's cache of freed blocks. Each bin is a list threaded through the
+ * first word of its blocks; bin b holds blocks with at least (b+1) * 
+ * TCACHE_STEP usable bytes. gen is the heap the blocks belong to.
+ */
+typedef struct {
+    void *bins[TCACHE_BINS];
+    unsigned int counts[TCACHE_BINS];
+    unsigned int gen;
+    struct arena *arena;        /* arena this thread allocates from */
+    unsigned int contended;     /* lock attempts that found it busy */
+} tcache_t;
+
+/* 
+ * An arena: an independent heap in a memlib region of its own, with its
+ * own free-block index, slab runs and lock. In thread-safe mode each thread
+ * allocates from one arena, and a block is always freed to the arena whose
+ * region holds it.
+ */
+typedef struct arena {
+    char *heap_listp;                   /* prologue block */
+    char *seg_lists[NUM_CLASSES];       /* heads of the segregated free lists */
+    char *tree_root;                    /* free blocks of TREE_MIN bytes and up */
+    char *rovers[NUM_CLASSES];          /* next fit: where each list's scan resumes */
+
+    unsigned int tlsf_fl_bitmap;                    /* non-empty first levels */
+    unsigned int tlsf_sl_bitmap[TLSF_FL_COUNT];     /* non-empty bins per level */
+    char *tlsf_lists[TLSF_FL_COUNT][TLSF_SL_COUNT]; /* heads of the TLSF bins */
+
+    run_t *slab_partial[SLAB_CLASSES];  /* runs with free slots, per class */
+    run_t **slab_runs;                  /* run starting in each granule */
+    size_t slab_granules;               /* entries slab_runs has room for */
+    char *slab_base;                    /* address of granule 1 */
+    size_t slab_top;                    /* granules slab_runs has used */
+
+    size_t grow_step;                   /* adaptive growth: bytes per extension */
+    unsigned int grow_ops;              /* mallocs since the heap last grew */
+
+    void *quick[QUICK_BINS];            /* deferred frees, still tagged allocated */
+    uint64_t quick_map[QUICK_WORDS];    /* non-empty quick lists */
+    size_t quick_bytes;                 /* bytes held in quick */
+
+    mem_region_t *region;               /* where the heap lives */
+    char *lo;                           /* first byte of region */
+    char *hi;                           /* end of the part of it in use */
+    pthread_mutex_t lock;               /* guards all of the above */
+} arena_t;
+
+/* A heap made by mm_heap_create: an arena apart from those of mm_init */
+struct mm_heap {
+    arena_t arena;
+};
+
+/* 
+ * A free-block index: how free blocks are filed, unfiled and searched.
+ * check walks the index for mm_checkheap and returns the number of blocks.
+ */
+typedef struct {
+    void (*init)(arena_t *a);
+    void *(*find_fit)(arena_t *a, size_t asize);
+    void (*insert)(arena_t *a, void *bp);
+    void (*remove)(arena_t *a, void *bp);
+    int (*check)(arena_t *a, int verbose);
+} engine_t;
+
 /* Global variables*/
-static char *heap_listp = 0; 
-static char *free_listp = 0;
+static arena_t arenas[MM_MAX_ARENAS];
+static int narenas;                 /* arenas in use by this heap */
+static unsigned int next_arena;     /* round-robin cursor for new threads */
+static long ncpus;                  /* online CPUs, the default arena count */
+static size_t mmap_threshold;       /* mm_opts.mmap_threshold for this heap */
+static size_t prefault;             /* mm_opts.prefault for this heap */
+static size_t mapped_bytes;         /* bytes held in mapped blocks */
+static size_t trim_threshold;       /* mm_opts.trim_threshold for this heap */
+static int defer;                   /* mm_opts.defer_coalesce for this heap */
+static int growth;                  /* mm_opts.growth for this heap */
+static int fit_scan;                /* mm_opts.fit_scan for this heap */
+
+static int thread_safe;             /* mm_opts.thread_safe for this heap */
+static unsigned int heap_gen;       /* bumped by mm_init, stales old caches */
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tcache_key;    /* runs tcache_flush at thread exit */
+/* initial-exec, so a preloaded libmm.so reaches it without a TLS call that could malloc */
+static __thread tcache_t tcache __attribute__((tls_model("initial-exec")));
+
+/* Internal helper routines */
+static void *heap_malloc(arena_t *a, size_t size);
+static void *heap_calloc(arena_t *a, size_t size);
+static void *heap_fit(arena_t *a, size_t asize);
+static void heap_free(arena_t *a, void *bp);
+static void heap_free_block(arena_t *a, void *bp);
+static void *heap_realloc(arena_t *a, void *ptr, size_t size);
+static size_t heap_malloc_batch(arena_t *a, size_t size, size_t n, void **ptrs);
+static size_t free_run(arena_t *a, void **ptrs, size_t n);
+static int ptr_cmp(const void *p, const void *q);
+static void *quick_pop(arena_t *a, size_t asize);
+static size_t usable_size(arena_t *a, void *bp);
+static size_t sized_usable(size_t size);
+static void *map_malloc(size_t size);
+static void *map_memalign(size_t align, size_t size);
+static void *heap_memalign(arena_t *a, size_t align, size_t size);
+static void map_free(void *bp);
+static void *map_realloc(void *bp, size_t size);
+static tcache_t *tcache_get(void);
+static void tcache_key_init(void);
+static void *tcache_malloc(size_t size);
+static void tcache_free(void *bp, size_t usable);
+static void tcache_flush(void *arg);
+static void *place(arena_t *a, void *bp, size_t asize);
+static size_t place_batch(arena_t *a, void *bp, size_t asize, size_t n, void **ptrs);
+static void shrink_block(arena_t *a, void *bp, size_t asize);
+static void free_block(arena_t *a, void *bp);
+static void quick_sweep(arena_t *a);
+static void *coalesce(arena_t *a, void *bp);
+static int trim_top(arena_t *a, void *bp, size_t pad);
+static int discard_block(arena_t *a, void *bp);
+static int arena_trim(arena_t *a);
+static void *slab_malloc(arena_t *a, size_t size);
+static void slab_free(arena_t *a, void *bp);
+static run_t *run_of(arena_t *a, void *bp);
+static run_t *run_new(arena_t *a, unsigned int cls);
+static void run_link(arena_t *a, run_t *run);
+static void run_unlink(arena_t *a, run_t *run);
+static void slab_check(arena_t *a, int verbose);
+static void seg_init(arena_t *a);
+static void *find_fit(arena_t *a, size_t asize);
+static int size_class(size_t size);
+static void *first_fit(arena_t *a, int cls, size_t asize);
+static void *next_fit(arena_t *a, int cls, size_t asize);
+static void *best_fit(arena_t *a, int cls, size_t asize);
+static void *good_fit(arena_t *a, int cls, size_t asize);
+static void insert_front(arena_t *a, void *bp);
+static void rmv_from_free(arena_t *a, void *bp);
+static int seg_check(arena_t *a, int verbose);
+static void tree_insert(arena_t *a, char *bp);
+static void tree_remove(arena_t *a, char *bp);
+static void *tree_best_fit(arena_t *a, size_t asize);
+static void tree_delete(arena_t *a, char *z);
+static void tree_replace(arena_t *a, char *old, char *new);
+static void tree_rotate_left(arena_t *a, char *x);
+static void tree_rotate_right(arena_t *a, char *x);
+static int tree_check(arena_t *a, char *node, int verbose, int *listed);
+static void tlsf_init(arena_t *a);
+static void tlsf_mapping(size_t size, int *fl, int *sl);
+static void *tlsf_find_fit(arena_t *a, size_t asize);
+static void tlsf_insert(arena_t *a, void *bp);
+static void tlsf_remove(arena_t *a, void *bp);
+static int tlsf_check(arena_t *a, int verbose);
+static void printBlock(void *bp);
+static void checkBlock(arena_t *a, void *bp);
+static int arena_init(arena_t *a, mem_region_t *region);
+static int slab_table(arena_t *a);
+static void *extend_arena(arena_t *a, size_t words);
+static void *grow_arena(arena_t *a, size_t asize);
+static arena_t *arena_of(void *bp);
+static arena_t *arena_lock(tcache_t *tc);
+static void arena_check(arena_t *a, int verbose);
+
+static const engine_t engines[] = {
+    [MM_ENGINE_SEGLIST] = { seg_init, find_fit, insert_front, rmv_from_free, seg_check },
+    [MM_ENGINE_TLSF] = { tlsf_init, tlsf_find_fit, tlsf_insert, tlsf_remove, tlsf_check },
+};
+static const engine_t *engine = &engines[MM_ENGINE_SEGLIST];
+
+/* Placement policies of the segregated lists, selected by mm_opts.placement */
+static void *(*const fits[])(arena_t *a, int cls, size_t asize) = {
+    [MM_FIT_FIRST] = first_fit,
+    [MM_FIT_NEXT] = next_fit,
+    [MM_FIT_BEST] = best_fit,
+    [MM_FIT_GOOD] = good_fit,
+};
+static void *(*list_fit)(arena_t *a, int cls, size_t asize) = first_fit;
+
+/* Options read by mm_init */
+mm_opts_t mm_opts = {
+    MM_ENGINE_SEGLIST,  /* engine */
+    0,                  /* thread_safe */
+    0,                  /* arenas: one per CPU */
+    0,                  /* mmap_threshold: never map */
+    0,                  /* trim_threshold: never trim on free */
+    0,                  /* defer_coalesce: coalesce on every free */
+    MM_GROWTH_ADAPTIVE, /* growth */
+    MM_FIT_FIRST,       /* placement */
+    8,                  /* fit_scan: good fit looks at 8 blocks */
+    0                   /* prefault: fault pages in as the heap grows */
+};
 
 team_t team = {
     /* Team name */
@@ -92,318 +511,2490 @@ team_t team = {
 
 /* 
  * mm_init - Initialize the malloc package.
- * This function gets four words from the memory system and initializes them
- * to create the empty free lists. It then calls the extend_heap function to 
- * extend the heap by CHUNKSIZE and creates inital free block.
+ * Sets up the arenas: one on the memlib heap, and in thread-safe mode up to
+ * MM_MAX_ARENAS - 1 more, each in a region of its own.
  */
 int mm_init(void)
 {
-    /* initialize an empty heap */
-    if ((heap_listp = mem_sbrk(2 * 24)) == NULL)
+    int i;
+
+    if (mm_opts.engine < 0 || mm_opts.engine >= MM_NUM_ENGINES)
+        return -1;
+    engine = &engines[mm_opts.engine];
+    if (mm_opts.placement < 0 || mm_opts.placement >= MM_NUM_FITS)
+        return -1;
+    list_fit = fits[mm_opts.placement];
+    fit_scan = MAX(1, mm_opts.fit_scan);
+    thread_safe = mm_opts.thread_safe;
+    mmap_threshold = mm_opts.mmap_threshold;
+    prefault = mm_opts.prefault;
+    trim_threshold = mm_opts.trim_threshold;
+    defer = mm_opts.defer_coalesce;
+    growth = mm_opts.growth;
+
+    narenas = 1;
+    if (thread_safe) {
+        if (ncpus == 0)     /* sysconf reads /sys, so only ask once */
+            ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        narenas = (mm_opts.arenas > 0) ? mm_opts.arenas : ncpus;
+        narenas = MAX(1, MIN(narenas, MM_MAX_ARENAS));
+    }
+
+    if (arena_init(&arenas[0], mem_default_region()) < 0)
+        return -1;
+    for (i = 1; i < narenas; i++) {
+        if (arenas[i].region == NULL &&
+            (arenas[i].region = mem_region_create(MIN(mem_max_heap(), HEAP_LIMIT))) == NULL)
+            return -1;
+        mem_region_reset(arenas[i].region);
+        if (arena_init(&arenas[i], arenas[i].region) < 0)
+            return -1;
+    }
+
+    next_arena = 0;
+    heap_gen++;        /* blocks cached by threads belonged to the old heap */
+    return 0;
+}
+
+/* 
+ * arena_init - Initialize an empty arena in region.
+ * This function gets four words from the region and initializes them
+ * to create the prologue and epilogue, and empties the selected engine's index.
+ * It then calls the extend_arena function to extend the heap by CHUNKSIZE and 
+ * creates inital free block.
+ */
+static int arena_init(arena_t *a, mem_region_t *region)
+{
+    a->region = region;
+    a->lo = mem_region_lo(region);
+    a->hi = a->lo + MIN(mem_region_capacity(region), HEAP_LIMIT);
+    pthread_mutex_init(&a->lock, NULL);
+    if (slab_table(a) < 0)
         return -1;
-    PUT(heap_listp, 0);                          /* alignment padding */
-    PUT(heap_listp + (1*WSIZE), PACK(24, 1));    /* prologue header */
-    PUT(heap_listp + (2*WSIZE), 0);              /* prologue footer */
-    PUT(heap_listp + (3*WSIZE), 0);              /* epilogue header */
 
-    PUT(heap_listp + 24, PACK(24,1));
-    PUT(heap_listp + WSIZE + 24, PACK(0,1));
+    /* fault in the part of the region the heap will grow into first */
+    if (prefault && mem_region_prefault(region, MIN(prefault, (size_t)(a->hi - a->lo))) < 0)
+        return -1;
+
+    /* 
+     * initialize an empty heap; with the region start ALIGNMENT-aligned, the
+     * four words leave the first block's payload ALIGNMENT-aligned too
+     */
+    if ((a->heap_listp = mem_region_sbrk(region, 4*WSIZE)) == (void *)-1)
+        return -1;
+    PUT(a->heap_listp, 0);                          /* alignment padding */
+    PUT(a->heap_listp + (1*WSIZE), PACK(DSIZE, 1)); /* prologue header */
+    PUT(a->heap_listp + (2*WSIZE), PACK(DSIZE, 1)); /* prologue footer */
+    PUT(a->heap_listp + (3*WSIZE), PACK(0, 1 | PREV_ALLOC)); /* epilogue header */
+    a->heap_listp += DSIZE;
+
+    engine->init(a);    /* initialize empty free lists */
 
-    free_listp = heap_listp + DSIZE;    /* initialize free explicit list */
+    /* no runs yet; granule 0 lies before the heap so every slot has a predecessor */
+    memset(a->slab_partial, 0, sizeof(a->slab_partial));
+    if (a->quick_bytes) {   /* blocks the old heap had deferred */
+        memset(a->quick, 0, sizeof(a->quick));
+        memset(a->quick_map, 0, sizeof(a->quick_map));
+        a->quick_bytes = 0;
+    }
+    memset(a->slab_runs, 0, a->slab_top * sizeof(run_t *));
+    a->slab_top = 0;
+    a->slab_base = a->lo - RUN_SIZE;
+
+    a->grow_step = CHUNKSIZE;
+    a->grow_ops = 0;
 
     /* Extend the empty heap witha  free block of CHUNKSIZE bytes */
-    if (extend_heap(CHUNKSIZE/WSIZE) == NULL)
+    if (extend_arena(a, CHUNKSIZE/WSIZE) == NULL)
         return -1;
       
     return 0;
 }
 
+/*
+ * slab_table - maps arena a a slab_runs table with an entry per granule of
+ * the part of its region it uses, unless the one it has is that size. The
+ * table is reserved like a region, so only the pages of entries that runs
+ * have used take memory.
+ */
+static int slab_table(arena_t *a)
+{
+    size_t granules = (a->hi - a->lo) / RUN_SIZE + 2;
+    void *table;
+
+    if (a->slab_runs != NULL && a->slab_granules == granules)
+        return 0;
+    table = mmap(NULL, granules * sizeof(run_t *), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (table == MAP_FAILED)
+        return -1;
+    if (a->slab_runs != NULL)
+        munmap(a->slab_runs, a->slab_granules * sizeof(run_t *));
+    a->slab_runs = table;
+    a->slab_granules = granules;
+    a->slab_top = 0;        /* the new table is already clear */
+    return 0;
+}
+
 /* 
- * mm_malloc - Allocate a block by incrementing the brk pointer.
- * An application would request a block of size bytes by calling mm_malloc.
- * The allocator must adjust the requested block size and call find_fit to
- * find an address to put the newly allocated block.
+ * mm_malloc - Allocate a block of at least size bytes.
+ * Requests of mmap_threshold bytes or more get a mapping of their own. In
+ * thread-safe mode small requests are served from the thread's cache and
+ * the rest from the thread's arena.
  */
 void *mm_malloc(size_t size)
 {
-    size_t asize;       /* adjusted block size */
-    size_t extendsize;  /* amount to extend heap if no fit */
-    char *bp;
+    arena_t *a;
+    void *bp;
 
-    if (size == 0)      /* ignore silly request */
+    if (mmap_threshold && size >= mmap_threshold)
+        return map_malloc(size);
+    if (!thread_safe)
+        return heap_malloc(&arenas[0], size);
+    if (size == 0)
         return NULL;
+    if (size <= TCACHE_MAX)
+        return tcache_malloc(size);
 
-    asize = MAX(ALIGN(size) + DSIZE, 24);
-
-    /* search list for a fit */
-    if ((bp = find_fit(asize)) != NULL) {
-        place(bp, asize);
-        return bp;
-    }
-
-    /* no fit found, get more memory and place on the block */
-    extendsize = MAX(asize, CHUNKSIZE);
-    if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
-        return NULL;
-    place(bp, asize);
+    a = arena_lock(tcache_get());
+    bp = heap_malloc(a, size);
+    pthread_mutex_unlock(&a->lock);
     return bp;
 }
 
 /*
  * mm_free - Frees a block of memory
- * Also adds the newly freed block to the list of free blocks.
- * Coalesces if possible.
+ * A block outside every arena is a mapped one and is unmapped. In
+ * thread-safe mode small blocks go to the thread's cache and the rest
+ * back to the arena that holds them.
  */
 void mm_free(void *bp)
 {
-    if(!bp) return; 
-  	size_t size = GET_SIZE(HDRP(bp));
+    arena_t *a;
+    size_t usable;
 
-    PUT(HDRP(bp), PACK(size, 0));
-    PUT(FTRP(bp), PACK(size, 0));
-    coalesce(bp);
+    if (!bp)
+        return;
+    if ((a = arena_of(bp)) == NULL) {
+        map_free(bp);
+        return;
+    }
+    if (!thread_safe) {
+        heap_free(a, bp);
+        return;
+    }
+    if ((usable = usable_size(a, bp)) <= TCACHE_MAX) {
+        tcache_free(bp, usable);
+        return;
+    }
+
+    pthread_mutex_lock(&a->lock);
+    heap_free(a, bp);
+    pthread_mutex_unlock(&a->lock);
 }
 
 /*
- * mm_realloc - Reallocates a block.
+ * mm_free_sized - Frees a block that was last allocated or reallocated 
+ * with size bytes. Mapped sizes are unmapped and sizes above SLAB_MAX 
+ * skip the slot lookup. The header is left unread only in thread-safe 
+ * mode, for sizes above SLAB_MAX up to TCACHE_MAX, which go into the 
+ * cache bin the size implies; any other heap block is freed by its 
+ * header, as mm_free does. Slab sizes are still looked up, as 
+ * mm_memalign serves them from heap blocks.
  */
-void *mm_realloc(void *ptr, size_t size)
+void mm_free_sized(void *bp, size_t size)
 {
-    void *oldptr = ptr;
-    void *newptr;
-    size_t copySize;
-    
-    newptr = mm_malloc(size);
-    if (newptr == NULL)
-      return NULL;
-    copySize = *(size_t *)((char *)oldptr - SIZE_T_SIZE);
-    if (size < copySize)
-      copySize = size;
-    memcpy(newptr, oldptr, copySize);
-    mm_free(oldptr);
-    return newptr;
+    arena_t *a;
+
+    if (!bp)
+        return;
+    if (mmap_threshold && size >= mmap_threshold) {
+        map_free(bp);
+        return;
+    }
+    a = arena_of(bp);
+    if (!thread_safe) {
+        if (size <= SLAB_MAX)
+            heap_free(a, bp);
+        else
+            heap_free_block(a, bp);
+        return;
+    }
+    if (size <= TCACHE_MAX) {
+        tcache_free(bp, (size <= SLAB_MAX) ? usable_size(a, bp) : sized_usable(size));
+        return;
+    }
+
+    pthread_mutex_lock(&a->lock);
+    heap_free_block(a, bp);
+    pthread_mutex_unlock(&a->lock);
 }
 
 /*
- * Coalesce - when a block is freed, this function merges its adjacent free
- * blocks to prevent false fragmentation. There exists 3 cases:
- * Case 1: The previous and next blocks are both allocated 
- * Case 2: The previous is allocated and next block is free
- * Case 3: The previous block is free and the next block is allocated.
- * Case 4: The previous and next blocks are both free
+ * mm_calloc - Allocates a zeroed block for nmemb elements of size bytes,
+ * or returns NULL if their total overflows. Mappings are fresh and need no
+ * clearing; heap blocks cut from storage never touched since the heap got
+ * it are only cleared where the free-block bookkeeping wrote.
  */
-static void *coalesce(void *bp)
+void *mm_calloc(size_t nmemb, size_t size)
 {
-    /* get tags of next and previous blocks */
-	size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp))) || PREV_BLKP(bp) == bp;
-	size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
-
-	size_t size = GET_SIZE(HDRP(bp));
-	
-    /* case 2 */
-	if (prev_alloc && !next_alloc)
-	{
-		size += GET_SIZE(HDRP(NEXT_BLKP(bp)));  /* add size of next free block */
-		rmv_from_free(NEXT_BLKP(bp));           /* remove the block from free list */
-		PUT(HDRP(bp), PACK(size, 0));
-		PUT(FTRP(bp), PACK(size, 0));
-	}
-
-    /* case 3 */
-	else if (!prev_alloc && next_alloc)
-	{
-	  size += GET_SIZE(HDRP(PREV_BLKP(bp)));    /* add size of previous free block */
-	  bp = PREV_BLKP(bp);
-	  rmv_from_free(bp);                         /* remove the block from free list */
-	  PUT(HDRP(bp), PACK(size, 0));
-	  PUT(FTRP(bp), PACK(size, 0));
-	}
+    arena_t *a;
+    void *bp;
 
-    /* case 4 */
-	else if (!prev_alloc && !next_alloc)
-	{	
-        /* add size of next and previous free block */
-		size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(HDRP(NEXT_BLKP(bp)));
-		rmv_from_free(PREV_BLKP(bp));   /* remove the block from free list */
-		rmv_from_free(NEXT_BLKP(bp));   /* remove the block from free list */
-		bp = PREV_BLKP(bp);
-		PUT(HDRP(bp), PACK(size, 0));
-		PUT(FTRP(bp), PACK(size, 0));
-	}
+    if (size && nmemb > (size_t)-1 / size)
+        return NULL;
+    size *= nmemb;
+    if (mmap_threshold && size >= mmap_threshold)
+        return map_malloc(size);
+    if (size <= (thread_safe ? TCACHE_MAX : SLAB_MAX)) {
+        if ((bp = mm_malloc(size)) != NULL)
+            memset(bp, 0, size);
+        return bp;
+    }
+    if (!thread_safe)
+        return heap_calloc(&arenas[0], size);
 
-    /* if case 1 occurs, it will drop down here without merging with any blocks */
-	insert_front(bp);
-	return bp;
+    a = arena_lock(tcache_get());
+    bp = heap_calloc(a, size);
+    pthread_mutex_unlock(&a->lock);
+    return bp;
 }
 
-/* 
- * extend_heap - extends the heap by the given number of words
- * This function is called when the free list does not have a block that is large
- * enough to accomodate for the requested payload. This function extends the heap
- * and creates a new free block.
+/*
+ * mm_memalign - Allocates a block of at least size bytes whose payload is
+ * aligned to align, a power of two. Alignments up to ALIGNMENT are plain
+ * mallocs. Otherwise the block comes from the heap, with the gap in front
+ * of the aligned payload split off as a free block, or for requests of 
+ * mmap_threshold bytes or more from a mapping trimmed to whole pages.
  */
-void *extend_heap(size_t words)
+void *mm_memalign(size_t align, size_t size)
 {
-    char *bp;
-    size_t size;
+    arena_t *a;
+    void *bp;
 
-    /* check alignment */
-    size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
-    if (size < 24)
-        size = 24;
-    if ((long)(bp = mem_sbrk(size)) == -1)
+    if (align == 0 || (align & (align - 1)) != 0)
         return NULL;
+    if (align <= ALIGNMENT)
+        return mm_malloc(size);
+    if (size == 0)
+        return NULL;
+    if (mmap_threshold && size >= mmap_threshold)
+        return map_memalign(align, size);
+    if (!thread_safe)
+        return heap_memalign(&arenas[0], align, size);
 
-    /* tag new blocks as unallocated */
-    PUT(HDRP(bp), PACK(size, 0));
-    PUT(FTRP(bp), PACK(size, 0));
-    PUT(HDRP(NEXT_BLKP(bp)), PACK(0,1));
-
-    /* coalesces if possible */
-    return coalesce(bp);            
+    a = arena_lock(tcache_get());
+    bp = heap_memalign(a, align, size);
+    pthread_mutex_unlock(&a->lock);
+    return bp;
 }
 
 /*
- * place - puts a block of asize at bp block
- * This function is called by malloc after it finds a block to put the 
- * payload in. The minimum block size is 16 bytes. 
+ * mm_usable_size - returns the bytes the caller may use at bp, which are 
+ * at least the size it was allocated with; 0 for NULL
  */
-static void place(void *bp, size_t asize)
+size_t mm_usable_size(void *bp)
 {
-    size_t csize = GET_SIZE(HDRP(bp));
+    arena_t *a;
 
-    /* difference is at least 24 bytes */
-    if ((csize - asize) >= (24)) {
-        PUT(HDRP(bp), PACK(asize, 1));
-        PUT(FTRP(bp), PACK(asize, 1));
-        rmv_from_free(bp);
-        bp = NEXT_BLKP(bp);
-        PUT(HDRP(bp), PACK(csize-asize, 0));
-        PUT(FTRP(bp), PACK(csize-asize, 0));
-        coalesce(bp);
-    }
-    /* not enough space for free block, don't split */
-    else {
-        PUT(HDRP(bp), PACK(csize, 1));
-        PUT(FTRP(bp), PACK(csize, 1));
-        rmv_from_free(bp);
-    }
+    if (!bp)
+        return 0;
+    if ((a = arena_of(bp)) == NULL)
+        return MAP_LEN(bp) - MAP_HDR - MAP_PAD(bp);
+    return usable_size(a, bp);
 }
 
 /*
- * find_fit - traverses the free list to find the first block that is 
- * greater than or equal to in size to requested asize. 
- * NOTE: originally implemented was best_fit search algorithm which would
- * find the smallest block that would accommodate the size, but that 
- * proved to be less efficient than this first-fit search
+ * mm_realloc - Reallocates a block within the arena that holds it, under 
+ * that arena's lock in thread-safe mode. A mapped block that stays above
+ * mmap_threshold is remapped; crossing the threshold either way copies.
  */
-static void *find_fit(size_t asize)
+void *mm_realloc(void *ptr, size_t size)
 {
+    arena_t *a;
     void *bp;
-	
-    /* traverse free list */
-    for (bp = free_listp; GET_ALLOC(HDRP(bp)) == 0; bp = NEXT_FREE_BLKP(bp)) {
-        if (asize <= (size_t)GET_SIZE(HDRP(bp)))
-	        return bp;
+    int map = mmap_threshold && size >= mmap_threshold;
+
+    if (ptr == NULL)
+        return mm_malloc(size);
+    if (size == 0) {
+        mm_free(ptr);
+        return NULL;
     }
 
-    return NULL; // No fit
-}
+    if ((a = arena_of(ptr)) == NULL) {
+        if (map)
+            return map_realloc(ptr, size);
+        if ((bp = mm_malloc(size)) == NULL)
+            return NULL;
+        memcpy(bp, ptr, size);  /* size is below the mapped payload */
+        map_free(ptr);
+        return bp;
+    }
+    if (map) {
+        if ((bp = map_malloc(size)) == NULL)
+            return NULL;
+        memcpy(bp, ptr, MIN(size, usable_size(a, ptr)));
+        mm_free(ptr);
+        return bp;
+    }
 
-/* 
- * insert_front - inserts free block bp at the front of the free_list
- * FILO (first in last out) free linked list, last node points to self
- */
-static void insert_front(void *bp)
-{
-    NEXT_FREE_BLKP(bp) = free_listp;
-    PREV_FREE_BLKP(free_listp) = bp;
-    PREV_FREE_BLKP(bp) = NULL;
-    free_listp = bp;
-	return; 
+    if (!thread_safe)
+        return heap_realloc(a, ptr, size);
+    pthread_mutex_lock(&a->lock);
+    bp = heap_realloc(a, ptr, size);
+    pthread_mutex_unlock(&a->lock);
+    return bp;
 }
 
 /*
- * rmv_from_free - removes a block from the free list once it has been
- * allocated and no longer free to use
+ * mm_malloc_batch - Allocates n blocks of size bytes each, storing them in 
+ * ptrs, and returns how many it allocated, fewer than n only when memory
+ * runs out. Neighboring blocks are carved from one free block in a single
+ * pass, with the arena searched and locked once per run rather than once
+ * per block.
  */
-static void rmv_from_free(void *bp)
+size_t mm_malloc_batch(size_t size, size_t n, void **ptrs)
 {
+    arena_t *a;
+    size_t got = 0;
 
-    if (PREV_FREE_BLKP(bp)) /* check if bp is the first block in list */
-        NEXT_FREE_BLKP(PREV_FREE_BLKP(bp)) = NEXT_FREE_BLKP(bp);
-    else 
-        free_listp = NEXT_FREE_BLKP(bp);
-
-    PREV_FREE_BLKP(NEXT_FREE_BLKP(bp)) = PREV_FREE_BLKP(bp);
+    if (mmap_threshold && size >= mmap_threshold) {
+        while (got < n && (ptrs[got] = map_malloc(size)) != NULL)
+            got++;
+        return got;
+    }
+    if (!thread_safe)
+        return heap_malloc_batch(&arenas[0], size, n, ptrs);
 
-    return;
+    a = arena_lock(tcache_get());
+    got = heap_malloc_batch(a, size, n, ptrs);
+    pthread_mutex_unlock(&a->lock);
+    return got;
 }
 
-/* 
- * printBlock - prints details of the block, used for debugging purposes
+/*
+ * mm_free_batch - Frees the n blocks in ptrs, skipping NULLs, and leaves 
+ * ptrs sorted by address. Each run of neighboring blocks is coalesced 
+ * once, and in thread-safe mode each arena is locked once.
  */
-static void printBlock(void *bp)
+void mm_free_batch(void **ptrs, size_t n)
 {
-	int hsize, halloc, fsize, falloc;
+    arena_t *a, *held = NULL;
+    size_t i;
 
-	hsize = GET_SIZE(HDRP(bp));
-	halloc = GET_ALLOC(HDRP(bp));
-	fsize = GET_SIZE(FTRP(bp));
-	falloc = GET_ALLOC(FTRP(bp));
-
-	if (hsize == 0){
-		printf("%p: EOL\n", bp);
-		return;
-	}
+    for (i = 1; i < n && (char *)ptrs[i - 1] <= (char *)ptrs[i]; i++)
+        ;
+    if (i < n)
+        qsort(ptrs, n, sizeof(void *), ptr_cmp);
 
-	if (halloc)
-		printf("%p: header:[%d:%c] footer:[%d:%c]\n", bp,hsize, (halloc ? 'a' : 'f'),fsize, (falloc ? 'a' : 'f'));
-	else
-		printf("%p:header:[%d:%c] prev:%p next:%p footer:[%d:%c]\n",bp, hsize, (halloc ? 'a' : 'f'), PREV_FREE_BLKP(bp),NEXT_FREE_BLKP(bp), fsize, (falloc ? 'a' : 'f'));
+    for (i = 0; i < n; ) {
+        if (ptrs[i] == NULL) {
+            i++;
+            continue;
+        }
+        if ((a = arena_of(ptrs[i])) == NULL) {
+            map_free(ptrs[i++]);
+            continue;
+        }
+        if (thread_safe && a != held) {
+            if (held)
+                pthread_mutex_unlock(&held->lock);
+            pthread_mutex_lock(&a->lock);
+            held = a;
+        }
+        i += free_run(a, ptrs + i, n - i);
+    }
+    if (held)
+        pthread_mutex_unlock(&held->lock);
 }
 
 /*
- * checkBlock - used to check the alignment, boundary, and footer/header of a block
- * used for debugging purposes
+ * extend_heap - extends the heap of the first arena by the given number of
+ * words; the arena is the one on the memlib heap
  */
-static void checkBlock(void *bp)
+void *extend_heap(size_t words)
 {
-	
-	if (NEXT_FREE_BLKP(bp)< mem_heap_lo() || NEXT_FREE_BLKP(bp) > mem_heap_hi())
-		printf("Next pointer: %p is out of bounds\n", NEXT_FREE_BLKP(bp));
+    return extend_arena(&arenas[0], words);
+}
 
-	if (PREV_FREE_BLKP(bp)< mem_heap_lo() || PREV_FREE_BLKP(bp) > mem_heap_hi())
-		printf("Previous pointer: %p is out of bounds\n", PREV_FREE_BLKP(bp));
-	
-	if ((size_t)bp % 8)
-		printf("%p is not aligned\n", bp);
-	
-	if (GET(HDRP(bp)) != GET(FTRP(bp)))
-		printf("Header and Footer do not match\n");
+/*
+ * mm_mapped_bytes - returns the bytes currently held in mapped blocks
+ */
+size_t mm_mapped_bytes(void)
+{
+    return mapped_bytes;
 }
 
 /*
- * mm_checkheap - calls checkBlock and printBlock to check for errors in the heap
- * used for debugging purposes
+ * mm_heap_create - Makes an independent heap in a region of size bytes of
+ * its own (mem_max_heap() if size is 0), or returns NULL, as it does for
+ * sizes past HEAP_LIMIT or when the region cannot be reserved. The heap
+ * follows the options of the last mm_init, except that it never maps 
+ * blocks, so that everything it holds lies in its region and 
+ * mm_heap_destroy can drop it all at once.
  */
-void mm_checkheap(int verbose)
+mm_heap_t *mm_heap_create(size_t size)
 {
-	void *bp = heap_listp; 
+    mm_heap_t *h;
+    mem_region_t *region;
 
-	if (verbose)
-		printf("Heap (%p):\n", heap_listp);
-		
-	if ((GET_SIZE(HDRP(heap_listp)) != 24) ||!GET_ALLOC(HDRP(heap_listp)))
-		printf("Bad prologue header\n");
-	checkBlock(heap_listp); 
+    if (size == 0)
+        size = MIN(mem_max_heap(), HEAP_LIMIT);
+    if (size > HEAP_LIMIT)
+        return NULL;
+    h = mmap(NULL, sizeof(mm_heap_t), PROT_READ | PROT_WRITE, 
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (h == MAP_FAILED)
+        return NULL;
+    if ((region = mem_region_create(size)) == NULL) {
+        munmap(h, sizeof(mm_heap_t));
+        return NULL;
+    }
+    if (arena_init(&h->arena, region) < 0) {
+        mm_heap_destroy(h);
+        return NULL;
+    }
+    return h;
+}
+
+/*
+ * mm_heap_destroy - Frees heap h and every block in it, in O(1): the 
+ * region and the heap's record are unmapped without visiting any block
+ */
+void mm_heap_destroy(mm_heap_t *h)
+{
+    pthread_mutex_destroy(&h->arena.lock);
+    if (h->arena.slab_runs != NULL)
+        munmap(h->arena.slab_runs, h->arena.slab_granules * sizeof(run_t *));
+    mem_region_destroy(h->arena.region);
+    munmap(h, sizeof(mm_heap_t));
+}
+
+/*
+ * mm_heap_malloc - mm_malloc from heap h, under its lock in thread-safe mode
+ */
+void *mm_heap_malloc(mm_heap_t *h, size_t size)
+{
+    void *bp;
+
+    if (!thread_safe)
+        return heap_malloc(&h->arena, size);
+    pthread_mutex_lock(&h->arena.lock);
+    bp = heap_malloc(&h->arena, size);
+    pthread_mutex_unlock(&h->arena.lock);
+    return bp;
+}
+
+/*
+ * mm_heap_memalign - mm_memalign from heap h
+ */
+void *mm_heap_memalign(mm_heap_t *h, size_t align, size_t size)
+{
+    void *bp;
+
+    if (align == 0 || (align & (align - 1)) != 0)
+        return NULL;
+    if (align <= ALIGNMENT)
+        return mm_heap_malloc(h, size);
+    if (size == 0)
+        return NULL;
+    if (!thread_safe)
+        return heap_memalign(&h->arena, align, size);
+    pthread_mutex_lock(&h->arena.lock);
+    bp = heap_memalign(&h->arena, align, size);
+    pthread_mutex_unlock(&h->arena.lock);
+    return bp;
+}
+
+/*
+ * mm_heap_free - frees a block of heap h; blocks of a heap never go 
+ * through the thread caches, which feed the arenas of mm_init
+ */
+void mm_heap_free(mm_heap_t *h, void *bp)
+{
+    if (!bp)
+        return;
+    if (!thread_safe) {
+        heap_free(&h->arena, bp);
+        return;
+    }
+    pthread_mutex_lock(&h->arena.lock);
+    heap_free(&h->arena, bp);
+    pthread_mutex_unlock(&h->arena.lock);
+}
+
+/*
+ * mm_heap_realloc - mm_realloc within heap h
+ */
+void *mm_heap_realloc(mm_heap_t *h, void *ptr, size_t size)
+{
+    void *bp;
+
+    if (!thread_safe)
+        return heap_realloc(&h->arena, ptr, size);
+    pthread_mutex_lock(&h->arena.lock);
+    bp = heap_realloc(&h->arena, ptr, size);
+    pthread_mutex_unlock(&h->arena.lock);
+    return bp;
+}
+
+/*
+ * mm_heap_size - returns the bytes of heap h's region in use
+ */
+size_t mm_heap_size(mm_heap_t *h)
+{
+    return mem_region_size(h->arena.region);
+}
+
+/*
+ * mm_heap_check - mm_checkheap for heap h
+ */
+void mm_heap_check(mm_heap_t *h, int verbose)
+{
+    arena_check(&h->arena, verbose);
+}
+
+/*
+ * map_malloc - gives a request a private anonymous mapping, rounded up to
+ * whole pages, that begins with its length and the block's MMAPPED header
+ */
+static void *map_malloc(size_t size)
+{
+    size_t page = mem_pagesize();
+    size_t len;
+    char *p;
+
+    if (size > SIZE_MAX - MAP_HDR - page)   /* the rounding would wrap */
+        return NULL;
+    len = (size + MAP_HDR + page - 1) & ~(page - 1);
+    p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    *(size_t *)p = len;
+    MAP_PAD(p + MAP_HDR) = 0;
+    PUT(HDRP(p + MAP_HDR), PACK(0, MMAPPED | 1));
+    __sync_fetch_and_add(&mapped_bytes, len);
+    return p + MAP_HDR;
+}
+
+/*
+ * map_memalign - maps a request whose payload is aligned to align bytes,
+ * unmapping the whole pages that the alignment leaves before and after it
+ */
+static void *map_memalign(size_t align, size_t size)
+{
+    size_t page = mem_pagesize();
+    size_t len;
+    size_t pad, cut;
+    char *p, *bp;
+
+    if (size > SIZE_MAX - MAP_HDR - align - page)   /* the rounding would wrap */
+        return NULL;
+    len = (size + MAP_HDR + align + page - 1) & ~(page - 1);
+    p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    bp = (char *)(((size_t)p + MAP_HDR + align - 1) & ~(align - 1));
+
+    /* give back the pages in front of the header and behind the payload */
+    if ((cut = (bp - MAP_HDR - p) & ~(page - 1)) != 0) {
+        munmap(p, cut);
+        p += cut;
+        len -= cut;
+    }
+    pad = bp - MAP_HDR - p;
+    if ((cut = len - ((pad + MAP_HDR + size + page - 1) & ~(page - 1))) != 0) {
+        munmap(p + len - cut, cut);
+        len -= cut;
+    }
+
+    MAP_LEN(bp) = len;
+    MAP_PAD(bp) = pad;
+    PUT(HDRP(bp), PACK(0, MMAPPED | 1));
+    __sync_fetch_and_add(&mapped_bytes, len);
+    return bp;
+}
+
+/*
+ * map_free - returns a mapped block's pages to the OS
+ */
+static void map_free(void *bp)
+{
+    size_t len = MAP_LEN(bp);
+
+    assert(GET(HDRP(bp)) & MMAPPED);
+    __sync_fetch_and_sub(&mapped_bytes, len);
+    munmap(MAP_START(bp), len);
+}
+
+/*
+ * map_realloc - resizes a mapped block with mremap, which may move it
+ * without copying its pages
+ */
+static void *map_realloc(void *bp, size_t size)
+{
+    size_t page = mem_pagesize();
+    size_t oldlen = MAP_LEN(bp);
+    size_t pad = MAP_PAD(bp);
+    size_t len;
+    char *p;
+
+    assert(GET(HDRP(bp)) & MMAPPED);
+    if (size > SIZE_MAX - MAP_HDR - page - pad)     /* the rounding would wrap */
+        return NULL;
+    len = (pad + size + MAP_HDR + page - 1) & ~(page - 1);
+    if (len == oldlen)
+        return bp;
+    p = mremap(MAP_START(bp), oldlen, len, MREMAP_MAYMOVE);
+    if (p == MAP_FAILED)
+        return NULL;
+    MAP_LEN(p + pad + MAP_HDR) = len;
+    __sync_fetch_and_add(&mapped_bytes, len - oldlen);
+    return p + pad + MAP_HDR;
+}
+
+/* 
+ * heap_malloc - Allocate a block by incrementing the brk pointer.
+ * An application would request a block of size bytes by calling mm_malloc.
+ * The allocator must adjust the requested block size and call find_fit to
+ * find an address to put the newly allocated block.
+ */
+static void *heap_malloc(arena_t *a, size_t size)
+{
+    size_t asize;       /* adjusted block size */
+    char *bp;
+
+    if (size == 0 || size >= HEAP_LIMIT)    /* ignore silly request */
+        return NULL;
+    a->grow_ops++;
+
+    if (size <= SLAB_MAX)   /* small requests come from a slab run */
+        return slab_malloc(a, size);
+
+    asize = MAX(ALIGN(size + WSIZE), MIN_BLOCK);
+
+    /* a deferred free of exactly this size is reused as it stands */
+    if (a->quick_bytes && (bp = quick_pop(a, asize)) != NULL)
+        return bp;
+
+    if ((bp = heap_fit(a, asize)) == NULL)
+        return NULL;
+    return place(a, bp, asize);
+}
+
+/*
+ * heap_fit - returns a free block of at least asize bytes. The index is
+ * searched, then searched again after merging the deferred frees, and if 
+ * there is still no fit the heap grows.
+ */
+static void *heap_fit(arena_t *a, size_t asize)
+{
+    void *bp;
+
+    if ((bp = engine->find_fit(a, asize)) != NULL)
+        return bp;
+    if (a->quick_bytes) {
+        quick_sweep(a);
+        if ((bp = engine->find_fit(a, asize)) != NULL)
+            return bp;
+    }
+    return grow_arena(a, asize);
+}
+
+/*
+ * heap_calloc - Allocates a zeroed heap block of size bytes. A block cut 
+ * from a ZEROED free block only needs the words the free block's links 
+ * and footer may have dirtied cleared: its first FREE_LINKS bytes, and the
+ * last DSIZE bytes, where the old footer lies if it ends the payload.
+ */
+static void *heap_calloc(arena_t *a, size_t size)
+{
+    size_t asize = MAX(ALIGN(size + WSIZE), MIN_BLOCK);
+    int zeroed;
+    char *bp;
+
+    if (size >= HEAP_LIMIT)
+        return NULL;
+    a->grow_ops++;
+    if (a->quick_bytes && (bp = quick_pop(a, asize)) != NULL) {
+        memset(bp, 0, size);
+        return bp;
+    }
+
+    if ((bp = heap_fit(a, asize)) == NULL)
+        return NULL;
+    zeroed = GET(HDRP(bp)) & ZEROED;
+    bp = place(a, bp, asize);
+
+    if (!zeroed)
+        memset(bp, 0, size);
+    else {
+        memset(bp, 0, MIN(size, FREE_LINKS));
+        memset(bp + size - MIN(size, DSIZE), 0, MIN(size, DSIZE));
+    }
+    return bp;
+}
+
+/*
+ * heap_malloc_batch - Allocates n blocks of size bytes into ptrs and returns
+ * how many it got. Deferred frees of the exact size are reused first. The 
+ * rest are carved in runs of up to BATCH_MAX bytes, each run from a single
+ * free block found by one find_fit: one that holds the whole run if there
+ * is one, else any block that holds at least one, else a heap extension.
+ */
+static size_t heap_malloc_batch(arena_t *a, size_t size, size_t n, void **ptrs)
+{
+    size_t asize, k, got = 0;
+    char *bp;
+
+    if (size == 0 || size >= HEAP_LIMIT)
+        return 0;
+    if (size <= SLAB_MAX) {     /* slab slots are already cheap one by one */
+        while (got < n && (ptrs[got] = heap_malloc(a, size)) != NULL)
+            got++;
+        return got;
+    }
+    a->grow_ops += n;
+
+    asize = MAX(ALIGN(size + WSIZE), MIN_BLOCK);
+    while (got < n && a->quick_bytes && (ptrs[got] = quick_pop(a, asize)) != NULL)
+        got++;
+
+    while (got < n) {
+        k = MIN(n - got, MAX(1, BATCH_MAX / asize));
+        if ((bp = engine->find_fit(a, k * asize)) == NULL &&
+            (bp = engine->find_fit(a, asize)) == NULL) {
+            if (a->quick_bytes) {
+                quick_sweep(a);
+                continue;
+            }
+            if ((bp = grow_arena(a, k * asize)) == NULL)
+                break;
+        }
+        got += place_batch(a, bp, asize, k, ptrs + got);
+    }
+    return got;
+}
+
+/*
+ * heap_memalign - Allocates a heap block whose payload is aligned to align.
+ * The first fit for the bare block is taken if an aligned payload fits in
+ * it; otherwise a block with room for any alignment gap is found or grown.
+ * A gap in front of the payload must be a free block of its own, so it is
+ * either empty or at least MIN_BLOCK bytes.
+ */
+static void *heap_memalign(arena_t *a, size_t align, size_t size)
+{
+    size_t asize = MAX(ALIGN(size + WSIZE), MIN_BLOCK);
+    size_t gap, csize;
+    char *bp;
+
+    if (size >= HEAP_LIMIT || align >= HEAP_LIMIT)
+        return NULL;
+    a->grow_ops++;
+
+    /* the first fit for the bare block will do if an aligned payload fits */
+    if ((bp = engine->find_fit(a, asize)) != NULL) {
+        gap = (0 - (size_t)bp) & (align - 1);
+        if ((gap != 0 && gap < MIN_BLOCK) || GET_SIZE(HDRP(bp)) < gap + asize)
+            bp = NULL;
+    }
+
+    /* otherwise take or grow a block with room for any gap */
+    if (bp == NULL) {
+        if (a->quick_bytes)
+            quick_sweep(a);
+        if ((bp = engine->find_fit(a, asize + align + MIN_BLOCK)) == NULL &&
+            (bp = grow_arena(a, asize + align + MIN_BLOCK)) == NULL)
+            return NULL;
+        if ((gap = (0 - (size_t)bp) & (align - 1)) != 0 && gap < MIN_BLOCK)
+            gap += align;
+    }
+
+    /* split off the gap, then cut the aligned block down to asize */
+    engine->remove(a, bp);
+    csize = GET_SIZE(HDRP(bp));
+    if (gap) {
+        PUT(HDRP(bp), PACK(gap, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(gap, 0));
+        engine->insert(a, bp);
+        bp += gap;
+        PUT(HDRP(bp), PACK(csize - gap, 1));
+    }
+    else
+        PUT(HDRP(bp), PACK(csize, 1 | PREV_ALLOC));
+    shrink_block(a, bp, asize);
+    return bp;
+}
+
+/*
+ * quick_pop - takes a deferred free of exactly asize bytes off its quick
+ * list, or returns NULL if there is none
+ */
+static void *quick_pop(arena_t *a, size_t asize)
+{
+    size_t i = QUICK_BIN(asize);
+    void *bp;
+
+    if (asize > QUICK_MAX || (bp = a->quick[i]) == NULL)
+        return NULL;
+    if ((a->quick[i] = *(void **)bp) == NULL)
+        a->quick_map[i / 64] &= ~(1ULL << (i % 64));
+    a->quick_bytes -= asize;
+    return bp;
+}
+
+/*
+ * heap_free - Frees a block of memory
+ * Slots are handed back to their slab run, blocks to heap_free_block.
+ */
+static void heap_free(arena_t *a, void *bp)
+{
+    if(!bp) return; 
+
+    if (run_of(a, bp))
+        slab_free(a, bp);
+    else
+        heap_free_block(a, bp);
+}
+
+/*
+ * heap_free_block - Frees heap block bp with free_block. With deferred 
+ * coalescing, blocks up to QUICK_MAX bytes are pushed unmerged onto the
+ * quick list of their size instead, keeping their allocated tags so that
+ * neither coalesce nor find_fit sees them.
+ */
+static void heap_free_block(arena_t *a, void *bp)
+{
+    size_t size, i;
+
+    if (defer && (size = GET_SIZE(HDRP(bp))) <= QUICK_MAX) {
+        i = QUICK_BIN(size);
+        *(void **)bp = a->quick[i];
+        a->quick[i] = bp;
+        a->quick_map[i / 64] |= 1ULL << (i % 64);
+        if ((a->quick_bytes += size) > QUICK_LIMIT)
+            quick_sweep(a);
+    }
+    else
+        free_block(a, bp);
+}
+
+/*
+ * free_run - frees the run of blocks at the start of ptrs, which is sorted,
+ * and returns how many entries it took. A slab slot or a block whose 
+ * successor is not next in ptrs is freed alone; a run of neighbors is
+ * retagged as one block and freed, coalescing once for all of them.
+ */
+static size_t free_run(arena_t *a, void **ptrs, size_t n)
+{
+    char *bp = ptrs[0];
+    size_t k = 1;
+
+    if (run_of(a, bp)) {
+        slab_free(a, bp);
+        return 1;
+    }
+    while (k < n && ptrs[k] == NEXT_BLKP(ptrs[k - 1]))
+        k++;
+    if (k == 1) {
+        heap_free(a, bp);
+        return 1;
+    }
+    PUT(HDRP(bp), PACK((char *)NEXT_BLKP(ptrs[k - 1]) - bp, 
+                       1 | GET_PREV_ALLOC(HDRP(bp))));
+    free_block(a, bp);
+    return k;
+}
+
+/*
+ * ptr_cmp - orders pointers by address for qsort
+ */
+static int ptr_cmp(const void *p, const void *q)
+{
+    char *x = *(char **)p, *y = *(char **)q;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * quick_sweep - frees and coalesces every block on the quick lists
+ */
+static void quick_sweep(arena_t *a)
+{
+    void *bp;
+    int w, i;
+
+    for (w = 0; w < QUICK_WORDS; w++) {
+        while (a->quick_map[w]) {
+            i = w * 64 + __builtin_ctzll(a->quick_map[w]);
+            a->quick_map[w] &= a->quick_map[w] - 1;
+            while ((bp = a->quick[i]) != NULL) {
+                a->quick[i] = *(void **)bp;
+                free_block(a, bp);
+            }
+        }
+    }
+    a->quick_bytes = 0;
+}
+
+/*
+ * free_block - Frees a heap block
+ * Also adds the newly freed block to the list of free blocks.
+ * Coalesces if possible.
+ */
+static void free_block(arena_t *a, void *bp)
+{
+  	size_t size = GET_SIZE(HDRP(bp));
+
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+    PUT(FTRP(bp), PACK(size, 0));
+    CLR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    bp = coalesce(a, bp);
+
+    /* 
+     * a last block past the trim threshold goes back to the OS, keeping 
+     * half the threshold so that a heap hovering at its top does not
+     * shrink and regrow on every free
+     */
+    if (trim_threshold && GET_SIZE(HDRP(bp)) >= trim_threshold &&
+        GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0)
+        trim_top(a, bp, trim_threshold / 2);
+}
+
+/*
+ * heap_realloc - Reallocates a block, in place whenever the neighbors allow.
+ * A shrinking block gives its tail back to the free lists. A growing block
+ * first absorbs a free successor, growing the heap by the shortfall when the
+ * block is the last one before the epilogue, then slides down into a free
+ * predecessor with memmove. Only when every neighbor is allocated is the
+ * payload copied to a new block.
+ */
+static void *heap_realloc(arena_t *a, void *ptr, size_t size)
+{
+    void *oldptr = ptr;
+    void *newptr;
+    void *next, *prev;
+    run_t *run;
+    size_t asize, oldsize, total;
+    size_t copySize;
+
+    if (ptr == NULL)
+        return heap_malloc(a, size);
+    if (size == 0) {
+        heap_free(a, ptr);
+        return NULL;
+    }
+    if (size >= HEAP_LIMIT)
+        return NULL;
+
+    /* 
+     * A slot stays put while the size keeps its slab class. Crossing into 
+     * or out of the slab range always moves, so slots and blocks never mix.
+     */
+    if ((run = run_of(a, oldptr)) != NULL) {
+        if (size <= SLAB_MAX && SLAB_CLASS(size) == run->cls)
+            return oldptr;
+        if ((newptr = heap_malloc(a, size)) == NULL)
+            return NULL;
+        memcpy(newptr, oldptr, MIN(size, (run->cls + 1) * SLAB_STEP));
+        slab_free(a, oldptr);
+        return newptr;
+    }
+    if (size <= SLAB_MAX) {
+        if ((newptr = slab_malloc(a, size)) == NULL)
+            return NULL;
+        memcpy(newptr, oldptr, size);
+        free_block(a, oldptr);
+        return newptr;
+    }
+
+    asize = MAX(ALIGN(size + WSIZE), MIN_BLOCK);
+    oldsize = GET_SIZE(HDRP(oldptr));
+
+    /* shrink, or grow within the existing block */
+    if (asize <= oldsize) {
+        shrink_block(a, oldptr, asize);
+        return oldptr;
+    }
+
+    /* last block before the epilogue: grow the heap by the shortfall */
+    next = NEXT_BLKP(oldptr);
+    if (GET_SIZE(HDRP(next)) == 0 ||
+        (!GET_ALLOC(HDRP(next)) && GET_SIZE(HDRP(NEXT_BLKP(next))) == 0)) {
+        total = oldsize + (GET_ALLOC(HDRP(next)) ? 0 : GET_SIZE(HDRP(next)));
+        if (total < asize && extend_arena(a, (asize - total) / WSIZE) == NULL)
+            return NULL;
+        next = NEXT_BLKP(oldptr);
+    }
+
+    /* absorb a free successor */
+    if (!GET_ALLOC(HDRP(next)) && oldsize + GET_SIZE(HDRP(next)) >= asize) {
+        engine->remove(a, next);
+        total = oldsize + GET_SIZE(HDRP(next));
+        PUT(HDRP(oldptr), PACK(total, 1 | GET_PREV_ALLOC(HDRP(oldptr))));
+        shrink_block(a, oldptr, asize);
+        return oldptr;
+    }
+
+    /* slide down into a free predecessor, taking a free successor too */
+    if (!GET_PREV_ALLOC(HDRP(oldptr))) {
+        prev = PREV_BLKP(oldptr);
+        total = GET_SIZE(HDRP(prev)) + oldsize;
+        if (!GET_ALLOC(HDRP(next)))
+            total += GET_SIZE(HDRP(next));
+        if (total >= asize) {
+            engine->remove(a, prev);
+            if (!GET_ALLOC(HDRP(next)))
+                engine->remove(a, next);
+            memmove(prev, oldptr, oldsize - WSIZE);
+            PUT(HDRP(prev), PACK(total, 1 | PREV_ALLOC));
+            shrink_block(a, prev, asize);
+            return prev;
+        }
+    }
+
+    /* every neighbor is in use: copy to a new block */
+    newptr = heap_malloc(a, size);
+    if (newptr == NULL)
+      return NULL;
+    copySize = MIN(size, oldsize - WSIZE);
+    memcpy(newptr, oldptr, copySize);
+    free_block(a, oldptr);
+    return newptr;
+}
+
+/*
+ * shrink_block - cuts allocated block bp, whose header is already written,
+ * down to asize bytes. If the tail is at least MIN_BLOCK bytes it becomes a
+ * free block and is coalesced with a free successor; otherwise the block 
+ * keeps it and only the successor's PREV_ALLOC bit is set.
+ */
+static void shrink_block(arena_t *a, void *bp, size_t asize)
+{
+    size_t csize = GET_SIZE(HDRP(bp));
+
+    if ((csize - asize) >= MIN_BLOCK) {
+        PUT(HDRP(bp), PACK(asize, 1 | GET_PREV_ALLOC(HDRP(bp))));
+        bp = NEXT_BLKP(bp);
+        PUT(HDRP(bp), PACK(csize-asize, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(csize-asize, 0));
+        CLR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+        coalesce(a, bp);
+    }
+    else
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+}
+
+/*
+ * Coalesce - when a block is freed, this function merges its adjacent free
+ * blocks to prevent false fragmentation. There exists 3 cases:
+ * Case 1: The previous and next blocks are both allocated 
+ * Case 2: The previous is allocated and next block is free
+ * Case 3: The previous block is free and the next block is allocated.
+ * Case 4: The previous and next blocks are both free
+ */
+static void *coalesce(arena_t *a, void *bp)
+{
+    /* get tags of next and previous blocks */
+	size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+	size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+
+	size_t size = GET_SIZE(HDRP(bp));
+	
+    /* case 2 */
+	if (prev_alloc && !next_alloc)
+	{
+		size += GET_SIZE(HDRP(NEXT_BLKP(bp)));  /* add size of next free block */
+		engine->remove(a, NEXT_BLKP(bp));          /* remove the block from free list */
+		PUT(HDRP(bp), PACK(size, PREV_ALLOC));
+		PUT(FTRP(bp), PACK(size, 0));
+	}
+
+    /* case 3 */
+	else if (!prev_alloc && next_alloc)
+	{
+	  size += GET_SIZE(HDRP(PREV_BLKP(bp)));    /* add size of previous free block */
+	  bp = PREV_BLKP(bp);
+	  engine->remove(a, bp);                        /* remove the block from free list */
+	  PUT(HDRP(bp), PACK(size, PREV_ALLOC));
+	  PUT(FTRP(bp), PACK(size, 0));
+	}
+
+    /* case 4 */
+	else if (!prev_alloc && !next_alloc)
+	{	
+        /* add size of next and previous free block */
+		size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(HDRP(NEXT_BLKP(bp)));
+		engine->remove(a, PREV_BLKP(bp));  /* remove the block from free list */
+		engine->remove(a, NEXT_BLKP(bp));  /* remove the block from free list */
+		bp = PREV_BLKP(bp);
+		PUT(HDRP(bp), PACK(size, PREV_ALLOC));
+		PUT(FTRP(bp), PACK(size, 0));
+	}
+
+    /* 
+     * if case 1 occurs, it will drop down here without merging with any blocks.
+     * A coalesced free block always follows an allocated one, hence PREV_ALLOC.
+     */
+	engine->insert(a, bp);
+	return bp;
+}
+
+/* 
+ * extend_arena - extends the heap of arena a by the given number of words
+ * This function is called when the free list does not have a block that is large
+ * enough to accomodate for the requested payload. This function extends the heap
+ * and creates a new free block.
+ */
+static void *extend_arena(arena_t *a, size_t words)
+{
+    char *bp, *zero = mem_region_zero(a->region);
+    size_t size, zeroed, room, grain, top;
+
+    /* keep blocks a multiple of ALIGNMENT */
+    size = ALIGN(words * WSIZE);
+    if (size < MIN_BLOCK)
+        size = MIN_BLOCK;
+    room = (size_t)(a->hi - a->lo) - mem_region_size(a->region);
+    if (size > room)
+        return NULL;
+
+    /* on huge pages, grow to the next huge page boundary, room permitting */
+    grain = mem_region_pagesize(a->region);
+    if (grain > mem_pagesize()) {
+        top = mem_region_size(a->region) + size;
+        top = ((top + grain - 1) & ~(grain - 1)) - mem_region_size(a->region);
+        if (top <= room)
+            size = top;
+    }
+    if ((long)(bp = mem_region_sbrk(a->region, size)) == -1)
+        return NULL;
+
+    /* 
+     * tag new blocks as unallocated, the old epilogue knows the last block;
+     * storage the heap has never touched is zero
+     */
+    zeroed = (zero <= bp) ? ZEROED : 0;
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)) | zeroed));
+    PUT(FTRP(bp), PACK(size, 0));
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0,1));
+    if (GET_PREV_ALLOC(HDRP(bp)))
+        return coalesce(a, bp);
+
+    /* 
+     * merging with a ZEROED last block keeps the tag once the old footer 
+     * and epilogue, now inside the block, are cleared, unless they are 
+     * under the merged block's links
+     */
+    zeroed &= GET(HDRP(PREV_BLKP(bp)));
+    zero = HDRP(bp) - WSIZE;
+    bp = coalesce(a, bp);
+    if (zeroed) {
+        if (zero >= bp + FREE_LINKS) {
+            PUT(zero, 0);
+            PUT(zero + WSIZE, 0);
+        }
+        PUT(HDRP(bp), GET(HDRP(bp)) | ZEROED);
+    }
+    return bp;
+}
+
+/*
+ * mm_trim - returns the free memory of every arena to the OS: the heap
+ * shrinks to just past its last allocated block, and the whole pages 
+ * inside other free blocks are discarded. Returns 1 if anything was released.
+ */
+int mm_trim(void)
+{
+    int i, released = 0;
+
+    for (i = 0; i < narenas; i++) {
+        if (thread_safe)
+            pthread_mutex_lock(&arenas[i].lock);
+        quick_sweep(&arenas[i]);
+        released |= arena_trim(&arenas[i]);
+        if (thread_safe)
+            pthread_mutex_unlock(&arenas[i].lock);
+    }
+    return released;
+}
+
+/*
+ * arena_trim - releases the pages of every free block in arena a. The last
+ * block shrinks the heap; any other keeps its tags and loses its interior.
+ */
+static int arena_trim(arena_t *a)
+{
+    char *bp, *next;
+    int released = 0;
+
+    for (bp = NEXT_BLKP(a->heap_listp); GET_SIZE(HDRP(bp)) > 0; bp = next) {
+        next = NEXT_BLKP(bp);
+        if (GET_ALLOC(HDRP(bp)))
+            continue;
+        if (GET_SIZE(HDRP(next)) == 0)
+            return released | trim_top(a, bp, 0);
+        released |= discard_block(a, bp);
+    }
+    return released;
+}
+
+/*
+ * trim_top - shrinks the heap so that its last block, the free block bp,
+ * ends at the first page boundary at least pad bytes into it
+ */
+static int trim_top(arena_t *a, void *bp, size_t pad)
+{
+    size_t page = mem_region_pagesize(a->region);
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t keep;
+
+    /* the new brk, just past the epilogue, is where the block ends */
+    keep = (((uintptr_t)bp + MAX(pad, MIN_BLOCK) + page - 1) & ~(page - 1)) - (uintptr_t)bp;
+    if (keep >= size)
+        return 0;
+
+    engine->remove(a, bp);
+    PUT(HDRP(bp), PACK(keep, GET_PREV_ALLOC(HDRP(bp))));
+    PUT(FTRP(bp), PACK(keep, 0));
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));   /* new epilogue */
+    engine->insert(a, bp);
+    mem_region_sbrk(a->region, -(intptr_t)(size - keep));
+    return 1;
+}
+
+/*
+ * discard_block - discards the whole pages between free block bp's index
+ * links and its footer; the OS hands them back zeroed when next touched
+ */
+static int discard_block(arena_t *a, void *bp)
+{
+    size_t page = mem_region_pagesize(a->region);
+    uintptr_t lo = ((uintptr_t)bp + FREE_LINKS + page - 1) & ~(page - 1);
+    uintptr_t hi = (uintptr_t)FTRP(bp) & ~(page - 1);
+
+    if (hi <= lo)
+        return 0;
+    madvise((void *)lo, hi - lo, MADV_DONTNEED);
+    return 1;
+}
+
+/*
+ * grow_arena - extends arena a so that its last block is a free block of
+ * at least asize bytes. A free last block is only topped up by the 
+ * shortfall; otherwise the heap grows by the growth policy's step. 
+ */
+static void *grow_arena(arena_t *a, size_t asize)
+{
+    char *epilogue = (char *)mem_region_hi(a->region) + 1;
+    size_t size;
+
+    if (!GET_PREV_ALLOC(HDRP(epilogue)))
+        size = asize - MIN(asize, GET_SIZE(HDRP(epilogue) - WSIZE));
+    else if (growth == MM_GROWTH_FIXED)
+        size = MAX(asize, CHUNKSIZE);
+    else {
+        if (a->grow_ops < GROW_FAST)
+            a->grow_step = MIN(a->grow_step * 2, MAX(CHUNKSIZE,
+                               MIN(GROW_MAX, mem_region_size(a->region) / GROW_SHARE)));
+        else if (a->grow_ops > GROW_STALL)
+            a->grow_step = MAX(a->grow_step / 2, CHUNKSIZE);
+        size = MAX(asize, a->grow_step);
+    }
+    a->grow_ops = 0;
+    return extend_arena(a, size / WSIZE);
+}
+
+/*
+ * usable_size - returns the payload bytes of the slot or block at bp
+ */
+static size_t usable_size(arena_t *a, void *bp)
+{
+    run_t *run = run_of(a, bp);
+
+    if (run != NULL)
+        return (run->cls + 1) * SLAB_STEP;
+    return GET_SIZE(HDRP(bp)) - WSIZE;
+}
+
+/*
+ * sized_usable - returns the fewest payload bytes a heap block allocated 
+ * with size bytes, more than SLAB_MAX, can have, without looking at it
+ */
+static size_t sized_usable(size_t size)
+{
+    return MAX(ALIGN(size + WSIZE), MIN_BLOCK) - WSIZE;
+}
+
+/*
+ * tcache_get - returns the calling thread's cache, emptied if its blocks 
+ * belong to an earlier heap, and registers it to be flushed at thread exit.
+ * A thread new to the heap is given the next arena in round-robin order.
+ */
+static tcache_t *tcache_get(void)
+{
+    tcache_t *tc = &tcache;
+
+    if (tc->gen != heap_gen) {
+        memset(tc, 0, sizeof(*tc));
+        tc->gen = heap_gen;
+        tc->arena = &arenas[__sync_fetch_and_add(&next_arena, 1) % narenas];
+        pthread_once(&tcache_once, tcache_key_init);
+        pthread_setspecific(tcache_key, tc);
+    }
+    return tc;
+}
+
+/*
+ * tcache_key_init - creates the key whose destructor flushes thread caches
+ */
+static void tcache_key_init(void)
+{
+    pthread_key_create(&tcache_key, tcache_flush);
+}
+
+/*
+ * tcache_malloc - pops a block from the bin for size, refilling the bin 
+ * with TCACHE_BATCH blocks from the thread's arena when it is empty
+ */
+static void *tcache_malloc(size_t size)
+{
+    tcache_t *tc = tcache_get();
+    int bin = (size - 1) / TCACHE_STEP;
+    arena_t *a;
+    void *bp;
+    int i;
+
+    if (tc->bins[bin] == NULL) {
+        a = arena_lock(tc);
+        for (i = 0; i < TCACHE_BATCH; i++) {
+            if ((bp = heap_malloc(a, (bin + 1) * TCACHE_STEP)) == NULL)
+                break;
+            *(void **)bp = tc->bins[bin];
+            tc->bins[bin] = bp;
+            tc->counts[bin]++;
+        }
+        pthread_mutex_unlock(&a->lock);
+        if (tc->bins[bin] == NULL)
+            return NULL;
+    }
+
+    bp = tc->bins[bin];
+    tc->bins[bin] = *(void **)bp;
+    tc->counts[bin]--;
+    return bp;
+}
+
+/*
+ * tcache_free - pushes bp on the bin for its usable size, first spilling 
+ * half of the bin back to the arenas that hold its blocks if it is full
+ */
+static void tcache_free(void *bp, size_t usable)
+{
+    tcache_t *tc = tcache_get();
+    int bin = usable / TCACHE_STEP - 1;
+    arena_t *a, *held = NULL;
+    void *next;
+
+    if (tc->counts[bin] >= TCACHE_FILL) {
+        while (tc->counts[bin] > TCACHE_FILL / 2) {
+            next = *(void **)tc->bins[bin];
+            if ((a = arena_of(tc->bins[bin])) != held) {
+                if (held)
+                    pthread_mutex_unlock(&held->lock);
+                pthread_mutex_lock(&a->lock);
+                held = a;
+            }
+            heap_free(a, tc->bins[bin]);
+            tc->bins[bin] = next;
+            tc->counts[bin]--;
+        }
+        if (held)
+            pthread_mutex_unlock(&held->lock);
+    }
+
+    *(void **)bp = tc->bins[bin];
+    tc->bins[bin] = bp;
+    tc->counts[bin]++;
+}
+
+/*
+ * tcache_flush - returns every block in an exiting thread's cache to its
+ * arena, unless the heap has been reinitialized since they were cached
+ */
+static void tcache_flush(void *arg)
+{
+    tcache_t *tc = arg;
+    arena_t *a;
+    void *bp;
+    int bin;
+
+    if (tc->gen != heap_gen)
+        return;
+    for (bin = 0; bin < TCACHE_BINS; bin++) {
+        while ((bp = tc->bins[bin]) != NULL) {
+            tc->bins[bin] = *(void **)bp;
+            a = arena_of(bp);
+            pthread_mutex_lock(&a->lock);
+            heap_free(a, bp);
+            pthread_mutex_unlock(&a->lock);
+        }
+        tc->counts[bin] = 0;
+    }
+}
+
+/*
+ * arena_of - returns the arena whose region holds bp, or NULL for a block
+ * outside every arena, which is a mapped one
+ */
+static arena_t *arena_of(void *bp)
+{
+    int i;
+
+    for (i = 0; i < narenas; i++) {
+        if ((char *)bp >= arenas[i].lo && (char *)bp < arenas[i].hi)
+            return &arenas[i];
+    }
+    return NULL;
+}
+
+/*
+ * arena_lock - locks and returns the thread's arena. Each time the lock is
+ * found busy counts against the arena; after ARENA_SWITCH such attempts 
+ * the thread moves on to the next arena.
+ */
+static arena_t *arena_lock(tcache_t *tc)
+{
+    arena_t *a = tc->arena;
+
+    if (pthread_mutex_trylock(&a->lock) == 0)
+        return a;
+
+    if (++tc->contended >= ARENA_SWITCH) {
+        a = tc->arena = &arenas[(a - arenas + 1) % narenas];
+        tc->contended = 0;
+    }
+    pthread_mutex_lock(&a->lock);
+    return a;
+}
+
+/*
+ * place - puts a block of asize at bp block
+ * This function is called by malloc after it finds a block to put the 
+ * payload in. The minimum block size is MIN_BLOCK bytes. Since bp is free,
+ * the block before it is allocated, and the block after it learns whether
+ * its new neighbor is allocated through its PREV_ALLOC bit.
+ */
+static void *place(arena_t *a, void *bp, size_t asize)
+{
+    size_t csize = GET_SIZE(HDRP(bp));
+    size_t zeroed = GET(HDRP(bp)) & ZEROED;
+
+    engine->remove(a, bp);  /* unlink while the header still names its size class */
+
+    /* 
+     * difference is at least MIN_BLOCK bytes, large blocks go at the back,
+     * except in the last block, whose rest must stay next to the epilogue
+     * to merge with the next heap extension
+     */
+    if ((csize - asize) >= MIN_BLOCK && asize >= SPLIT_BACK &&
+        GET_SIZE(HDRP(NEXT_BLKP(bp))) != 0) {
+        PUT(HDRP(bp), PACK(csize-asize, PREV_ALLOC | zeroed));
+        PUT(FTRP(bp), PACK(csize-asize, 0));
+        engine->insert(a, bp);
+        bp = NEXT_BLKP(bp);
+        PUT(HDRP(bp), PACK(asize, 1));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    }
+    /* difference is at least MIN_BLOCK bytes, small blocks go at the front */
+    else if ((csize - asize) >= MIN_BLOCK) {
+        PUT(HDRP(bp), PACK(asize, 1 | PREV_ALLOC));
+        PUT(HDRP(NEXT_BLKP(bp)), PACK(csize-asize, PREV_ALLOC | zeroed));
+        PUT(FTRP(NEXT_BLKP(bp)), PACK(csize-asize, 0));
+        coalesce(a, NEXT_BLKP(bp));
+    }
+    /* not enough space for free block, don't split */
+    else {
+        PUT(HDRP(bp), PACK(csize, 1 | PREV_ALLOC));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    }
+    return bp;
+}
+
+/*
+ * place_batch - carves up to n blocks of asize bytes from the front of free
+ * block bp, storing them in ptrs, and returns how many it carved. What is 
+ * left becomes a free block, or pads the last block if too small for one.
+ */
+static size_t place_batch(arena_t *a, void *bp, size_t asize, size_t n, void **ptrs)
+{
+    size_t csize = GET_SIZE(HDRP(bp));
+    size_t k = MIN(n, csize / asize);
+    size_t rest = csize - k * asize;
+    size_t i;
+
+    engine->remove(a, bp);
+    for (i = 0; i < k; i++) {
+        ptrs[i] = bp;
+        if (i == k - 1 && rest < MIN_BLOCK)
+            PUT(HDRP(bp), PACK(asize + rest, 1 | PREV_ALLOC));
+        else
+            PUT(HDRP(bp), PACK(asize, 1 | PREV_ALLOC));
+        bp = NEXT_BLKP(bp);
+    }
+
+    if (rest >= MIN_BLOCK) {
+        PUT(HDRP(bp), PACK(rest, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(rest, 0));
+        coalesce(a, bp);
+    }
+    else
+        SET_PREV_ALLOC(HDRP(bp));
+    return k;
+}
+
+/*
+ * slab_malloc - pops a slot of the size class of size from the first run 
+ * of that class with a free slot, starting a new run if there is none
+ */
+static void *slab_malloc(arena_t *a, size_t size)
+{
+    unsigned int cls = SLAB_CLASS(size);
+    run_t *run = a->slab_partial[cls];
+    void *bp;
+
+    if (run == NULL && (run = run_new(a, cls)) == NULL)
+        return NULL;
+
+    if (run->free_slots) {
+        bp = run->free_slots;
+        run->free_slots = *(void **)bp;
+    }
+    else {
+        bp = run->unused;
+        run->unused += (cls + 1) * SLAB_STEP;
+    }
+
+    if (--run->nfree == 0)  /* full runs leave the list */
+        run_unlink(a, run);
+    return bp;
+}
+
+/*
+ * slab_free - pushes slot bp back on its run. A run that becomes empty is 
+ * returned to the heap, unless it is the last run of its class with room.
+ * In thread-safe mode runs are never returned: mm_free looks up a pointer's
+ * run without its arena's lock, which is only safe while runs stay put.
+ */
+static void slab_free(arena_t *a, void *bp)
+{
+    run_t *run = run_of(a, bp);
+
+    *(void **)bp = run->free_slots;
+    run->free_slots = bp;
+
+    if (run->nfree++ == 0)  /* was full, has room again */
+        run_link(a, run);
+
+    if ((char *)run + RUN_HDR + run->nfree * (run->cls + 1) * SLAB_STEP == run->end &&
+        (run->next || run->prev) && !thread_safe) {
+        run_unlink(a, run);
+        a->slab_runs[GRANULE(a, run)] = NULL;
+        free_block(a, run);
+    }
+}
+
+/*
+ * run_of - returns the run holding slot bp, or NULL if bp is a heap block
+ */
+static run_t *run_of(arena_t *a, void *bp)
+{
+    size_t g = GRANULE(a, bp);
+    run_t *run = a->slab_runs[g];
+
+    if (run != NULL && (char *)bp > (char *)run)
+        return run;
+    run = a->slab_runs[g - 1];
+    if (run != NULL && (char *)bp < run->end)
+        return run;
+    return NULL;
+}
+
+/*
+ * run_new - gets a RUN_SIZE block from the heap, growing it if needed, 
+ * records it in its granule as a run of class cls and links it in
+ */
+static run_t *run_new(arena_t *a, unsigned int cls)
+{
+    size_t slot = (cls + 1) * SLAB_STEP;
+    run_t *run;
+    void *bp;
+
+    if ((bp = engine->find_fit(a, RUN_SIZE)) == NULL &&
+        (bp = grow_arena(a, RUN_SIZE)) == NULL)
+        return NULL;
+    run = place(a, bp, RUN_SIZE);
+
+    run->free_slots = NULL;
+    run->unused = (char *)run + RUN_HDR;
+    run->nfree = (RUN_SIZE - WSIZE - RUN_HDR) / slot;
+    run->end = run->unused + run->nfree * slot;
+    run->cls = cls;
+    run_link(a, run);
+    a->slab_runs[GRANULE(a, run)] = run;
+    a->slab_top = MAX(a->slab_top, GRANULE(a, run) + 1);
+    return run;
+}
+
+/*
+ * run_link - puts run at the front of its class's list of runs with room
+ */
+static void run_link(arena_t *a, run_t *run)
+{
+    run->prev = NULL;
+    run->next = a->slab_partial[run->cls];
+    if (run->next)
+        run->next->prev = run;
+    a->slab_partial[run->cls] = run;
+}
+
+/*
+ * run_unlink - takes run off its class's list of runs with room
+ */
+static void run_unlink(arena_t *a, run_t *run)
+{
+    if (run->prev)
+        run->prev->next = run->next;
+    else
+        a->slab_partial[run->cls] = run->next;
+    if (run->next)
+        run->next->prev = run->prev;
+}
+
+/*
+ * seg_init - empties every segregated free list
+ */
+static void seg_init(arena_t *a)
+{
+    int i;
+
+    for (i = 0; i < NUM_CLASSES; i++)
+        a->seg_lists[i] = a->rovers[i] = NULL;
+    a->tree_root = NULL;
+}
+
+/*
+ * find_fit - starts at the size class of asize and asks the placement 
+ * policy for a block of at least asize bytes in its free list. If the 
+ * class has no fit, the next non-empty larger class is tried, where every
+ * block is big enough, so first fit simply takes the head. Requests the 
+ * lists cannot serve get the best fit from the tree of large blocks.
+ * NOTE: originally implemented was best_fit search algorithm which would
+ * find the smallest block that would accommodate the size, but that 
+ * proved to be less efficient than this first-fit search on a linear
+ * list; the tree makes best fit an O(log n) walk for large blocks.
+ */
+static void *find_fit(arena_t *a, size_t asize)
+{
+    void *bp;
+    int cls, tree_cls = size_class(TREE_MIN);
+
+    if (asize >= TREE_MIN)
+        return tree_best_fit(a, asize);
+
+    for (cls = size_class(asize); cls < tree_cls; cls++) {
+        if (a->seg_lists[cls] != NULL && (bp = list_fit(a, cls, asize)) != NULL)
+            return bp;
+    }
+    return tree_best_fit(a, asize);
+}
+
+/*
+ * first_fit - returns the first block of list cls with at least asize bytes
+ */
+static void *first_fit(arena_t *a, int cls, size_t asize)
+{
+    void *bp;
+
+    for (bp = a->seg_lists[cls]; bp != NULL; bp = NEXT_FREE_BLKP(bp)) {
+        if (asize <= (size_t)GET_SIZE(HDRP(bp)))
+	        return bp;
+    }
+    return NULL;
+}
+
+/*
+ * next_fit - first fit that starts at list cls's rover, the block after
+ * the last one taken from it, and wraps around to the head
+ */
+static void *next_fit(arena_t *a, int cls, size_t asize)
+{
+    char *rover = a->rovers[cls];
+    void *bp;
+
+    for (bp = rover; bp != NULL; bp = NEXT_FREE_BLKP(bp)) {
+        if (asize <= (size_t)GET_SIZE(HDRP(bp)))
+            break;
+    }
+    if (bp == NULL) {
+        for (bp = a->seg_lists[cls]; bp != rover; bp = NEXT_FREE_BLKP(bp)) {
+            if (asize <= (size_t)GET_SIZE(HDRP(bp)))
+                break;
+        }
+        if (bp == rover)    /* wrapped around without a fit */
+            return NULL;
+    }
+    a->rovers[cls] = NEXT_FREE_BLKP(bp);   /* the next scan resumes after bp */
+    return bp;
+}
+
+/*
+ * best_fit - returns the smallest block of list cls with at least asize 
+ * bytes, stopping early at an exact fit
+ */
+static void *best_fit(arena_t *a, int cls, size_t asize)
+{
+    void *bp, *best = NULL;
+    size_t size, best_size = (size_t)-1;
+
+    for (bp = a->seg_lists[cls]; bp != NULL; bp = NEXT_FREE_BLKP(bp)) {
+        size = GET_SIZE(HDRP(bp));
+        if (size >= asize && size < best_size) {
+            best = bp;
+            if ((best_size = size) == asize)
+                break;
+        }
+    }
+    return best;
+}
+
+/*
+ * good_fit - best fit among the first fit_scan blocks of list cls, 
+ * counting those too small for asize, so the scan is bounded however
+ * long the list is
+ */
+static void *good_fit(arena_t *a, int cls, size_t asize)
+{
+    void *bp, *best = NULL;
+    size_t size, best_size = (size_t)-1;
+    int seen = 0;
+
+    for (bp = a->seg_lists[cls]; bp != NULL && seen < fit_scan; bp = NEXT_FREE_BLKP(bp)) {
+        size = GET_SIZE(HDRP(bp));
+        seen++;
+        if (size >= asize && size < best_size) {
+            best = bp;
+            if ((best_size = size) == asize)
+                break;
+        }
+    }
+    return best;
+}
+
+/*
+ * size_class - maps a block size to the index of its segregated free list
+ */
+static int size_class(size_t size)
+{
+    int cls = FLS(size) + 1 - MIN_CLASS_SHIFT;
+
+    if (cls < 0)
+        return 0;
+    return (cls < NUM_CLASSES) ? cls : NUM_CLASSES - 1;
+}
+
+/* 
+ * insert_front - inserts free block bp at the front of its size class list
+ * FILO (first in last out) free linked lists, terminated by NULL
+ */
+static void insert_front(arena_t *a, void *bp)
+{
+    char **head;
+
+    if (GET_SIZE(HDRP(bp)) >= TREE_MIN) {
+        tree_insert(a, bp);
+        return;
+    }
+
+    head = &a->seg_lists[size_class(GET_SIZE(HDRP(bp)))];
+
+    NEXT_FREE_BLKP(bp) = *head;
+    if (*head)
+        PREV_FREE_BLKP(*head) = bp;
+    PREV_FREE_BLKP(bp) = NULL;
+    *head = bp;
+	return; 
+}
+
+/*
+ * rmv_from_free - removes a block from its size class list once it has been
+ * allocated and no longer free to use. Must be called before the block's
+ * header is rewritten with a new size.
+ */
+static void rmv_from_free(arena_t *a, void *bp)
+{
+    int cls;
+
+    if (GET_SIZE(HDRP(bp)) >= TREE_MIN) {
+        tree_remove(a, bp);
+        return;
+    }
+
+    cls = size_class(GET_SIZE(HDRP(bp)));
+    if (a->rovers[cls] == bp)   /* next fit resumes after a taken block */
+        a->rovers[cls] = NEXT_FREE_BLKP(bp);
+
+    if (PREV_FREE_BLKP(bp)) /* check if bp is the first block in list */
+        NEXT_FREE_BLKP(PREV_FREE_BLKP(bp)) = NEXT_FREE_BLKP(bp);
+    else 
+        a->seg_lists[cls] = NEXT_FREE_BLKP(bp);
+
+    if (NEXT_FREE_BLKP(bp))
+        PREV_FREE_BLKP(NEXT_FREE_BLKP(bp)) = PREV_FREE_BLKP(bp);
+
+    return;
+}
+
+/*
+ * seg_check - checks every block in the segregated lists and the tree, 
+ * returns their count
+ */
+static int seg_check(arena_t *a, int verbose)
+{
+	void *bp;
+	int cls, listed = 0, roved;
+
+	for (cls = 0; cls < NUM_CLASSES; cls++) {
+		roved = a->rovers[cls] == NULL;
+		for (bp = a->seg_lists[cls]; bp != NULL; bp = NEXT_FREE_BLKP(bp)) {
+			roved |= bp == a->rovers[cls];
+			if (verbose)
+				printBlock(bp);
+			checkBlock(a, bp);
+			if (size_class(GET_SIZE(HDRP(bp))) != cls)
+				printf("%p: block in wrong size class %d\n", bp, cls);
+			if (GET_SIZE(HDRP(bp)) >= TREE_MIN)
+				printf("%p: tree-sized block on a list\n", bp);
+			listed++;
+		}
+		if (!roved)
+			printf("%p: rover of class %d not on its list\n", a->rovers[cls], cls);
+	}
+
+	if (a->tree_root != NULL) {
+		if (TREE_PARENT(a->tree_root) != NULL || TREE_RED(a->tree_root))
+			printf("%p: bad tree root\n", a->tree_root);
+		tree_check(a, a->tree_root, verbose, &listed);
+	}
+	return listed;
+}
+
+/*
+ * tree_insert - adds free block bp to the tree. A block whose size is 
+ * already in the tree is chained behind that node through its list links;
+ * otherwise bp becomes a red leaf and the tree is rebalanced.
+ */
+static void tree_insert(arena_t *a, char *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    char *parent = NULL, *node = a->tree_root;
+    char *g, *u;
+
+    while (node != NULL) {
+        if (GET_SIZE(HDRP(node)) == size) {
+            PREV_FREE_BLKP(bp) = node;
+            NEXT_FREE_BLKP(bp) = NEXT_FREE_BLKP(node);
+            if (NEXT_FREE_BLKP(node))
+                PREV_FREE_BLKP(NEXT_FREE_BLKP(node)) = bp;
+            NEXT_FREE_BLKP(node) = bp;
+            return;
+        }
+        parent = node;
+        node = (size < GET_SIZE(HDRP(node))) ? TREE_LEFT(node) : TREE_RIGHT(node);
+    }
+
+    /* a tree node has no PREV link, which is how remove tells it apart */
+    PREV_FREE_BLKP(bp) = NULL;
+    NEXT_FREE_BLKP(bp) = NULL;
+    TREE_LEFT(bp) = TREE_RIGHT(bp) = NULL;
+    TREE_PARENT(bp) = parent;
+    TREE_RED(bp) = 1;
+    if (parent == NULL)
+        a->tree_root = bp;
+    else if (size < GET_SIZE(HDRP(parent)))
+        TREE_LEFT(parent) = bp;
+    else
+        TREE_RIGHT(parent) = bp;
+
+    /* restore the red-black rules, recoloring or rotating up the tree */
+    while ((parent = TREE_PARENT(bp)) != NULL && TREE_RED(parent)) {
+        g = TREE_PARENT(parent);    /* the root is black, so parent is not it */
+        if (parent == TREE_LEFT(g)) {
+            u = TREE_RIGHT(g);
+            if (u != NULL && TREE_RED(u)) {
+                TREE_RED(parent) = TREE_RED(u) = 0;
+                TREE_RED(g) = 1;
+                bp = g;
+                continue;
+            }
+            if (bp == TREE_RIGHT(parent)) {
+                bp = parent;
+                tree_rotate_left(a, bp);
+                parent = TREE_PARENT(bp);
+            }
+            TREE_RED(parent) = 0;
+            TREE_RED(g) = 1;
+            tree_rotate_right(a, g);
+        }
+        else {
+            u = TREE_LEFT(g);
+            if (u != NULL && TREE_RED(u)) {
+                TREE_RED(parent) = TREE_RED(u) = 0;
+                TREE_RED(g) = 1;
+                bp = g;
+                continue;
+            }
+            if (bp == TREE_LEFT(parent)) {
+                bp = parent;
+                tree_rotate_right(a, bp);
+                parent = TREE_PARENT(bp);
+            }
+            TREE_RED(parent) = 0;
+            TREE_RED(g) = 1;
+            tree_rotate_left(a, g);
+        }
+    }
+    TREE_RED(a->tree_root) = 0;
+}
+
+/*
+ * tree_remove - takes free block bp out of the tree. A chained block is
+ * simply unlinked; a node with a chain hands its place to the first block
+ * of the chain, so only a node of a unique size is deleted from the tree.
+ */
+static void tree_remove(arena_t *a, char *bp)
+{
+    char *d;
+
+    if (PREV_FREE_BLKP(bp) != NULL) {
+        NEXT_FREE_BLKP(PREV_FREE_BLKP(bp)) = NEXT_FREE_BLKP(bp);
+        if (NEXT_FREE_BLKP(bp))
+            PREV_FREE_BLKP(NEXT_FREE_BLKP(bp)) = PREV_FREE_BLKP(bp);
+        return;
+    }
+
+    if ((d = NEXT_FREE_BLKP(bp)) != NULL) {
+        PREV_FREE_BLKP(d) = NULL;
+        TREE_LEFT(d) = TREE_LEFT(bp);
+        TREE_RIGHT(d) = TREE_RIGHT(bp);
+        TREE_PARENT(d) = TREE_PARENT(bp);
+        TREE_RED(d) = TREE_RED(bp);
+        if (TREE_LEFT(d))
+            TREE_PARENT(TREE_LEFT(d)) = d;
+        if (TREE_RIGHT(d))
+            TREE_PARENT(TREE_RIGHT(d)) = d;
+        tree_replace(a, bp, d);
+        return;
+    }
+
+    tree_delete(a, bp);
+}
+
+/*
+ * tree_best_fit - returns the smallest free block of at least asize bytes
+ * in the tree, or NULL. A chained block of that size is preferred to the
+ * node itself, since taking it leaves the tree's shape alone.
+ */
+static void *tree_best_fit(arena_t *a, size_t asize)
+{
+    char *node = a->tree_root, *best = NULL;
+    size_t size;
+
+    while (node != NULL) {
+        size = GET_SIZE(HDRP(node));
+        if (size == asize) {
+            best = node;
+            break;
+        }
+        if (size < asize)
+            node = TREE_RIGHT(node);
+        else {
+            best = node;
+            node = TREE_LEFT(node);
+        }
+    }
+    if (best != NULL && NEXT_FREE_BLKP(best) != NULL)
+        return NEXT_FREE_BLKP(best);
+    return best;
+}
+
+/*
+ * tree_delete - unlinks node z from the tree and rebalances it. Empty 
+ * children are NULL, so the fix-up tracks the parent of x itself.
+ */
+static void tree_delete(arena_t *a, char *z)
+{
+    char *x, *xp, *y = z, *w;
+    long y_red = TREE_RED(z);
+
+    if (TREE_LEFT(z) == NULL || TREE_RIGHT(z) == NULL) {
+        x = TREE_LEFT(z) ? TREE_LEFT(z) : TREE_RIGHT(z);
+        xp = TREE_PARENT(z);
+        tree_replace(a, z, x);
+    }
+    else {
+        /* z's successor y takes its place, and y's right child takes y's */
+        for (y = TREE_RIGHT(z); TREE_LEFT(y) != NULL; y = TREE_LEFT(y))
+            ;
+        y_red = TREE_RED(y);
+        x = TREE_RIGHT(y);
+        if (TREE_PARENT(y) == z)
+            xp = y;
+        else {
+            xp = TREE_PARENT(y);
+            tree_replace(a, y, x);
+            TREE_RIGHT(y) = TREE_RIGHT(z);
+            TREE_PARENT(TREE_RIGHT(y)) = y;
+        }
+        tree_replace(a, z, y);
+        TREE_LEFT(y) = TREE_LEFT(z);
+        TREE_PARENT(TREE_LEFT(y)) = y;
+        TREE_RED(y) = TREE_RED(z);
+    }
+    if (y_red)
+        return;
+
+    /* x carries an extra black; push it up or rotate it away */
+    while (x != a->tree_root && (x == NULL || !TREE_RED(x))) {
+        if (x == TREE_LEFT(xp)) {
+            w = TREE_RIGHT(xp);
+            if (TREE_RED(w)) {
+                TREE_RED(w) = 0;
+                TREE_RED(xp) = 1;
+                tree_rotate_left(a, xp);
+                w = TREE_RIGHT(xp);
+            }
+            if ((TREE_LEFT(w) == NULL || !TREE_RED(TREE_LEFT(w))) &&
+                (TREE_RIGHT(w) == NULL || !TREE_RED(TREE_RIGHT(w)))) {
+                TREE_RED(w) = 1;
+                x = xp;
+                xp = TREE_PARENT(x);
+                continue;
+            }
+            if (TREE_RIGHT(w) == NULL || !TREE_RED(TREE_RIGHT(w))) {
+                TREE_RED(TREE_LEFT(w)) = 0;
+                TREE_RED(w) = 1;
+                tree_rotate_right(a, w);
+                w = TREE_RIGHT(xp);
+            }
+            TREE_RED(w) = TREE_RED(xp);
+            TREE_RED(xp) = 0;
+            TREE_RED(TREE_RIGHT(w)) = 0;
+            tree_rotate_left(a, xp);
+        }
+        else {
+            w = TREE_LEFT(xp);
+            if (TREE_RED(w)) {
+                TREE_RED(w) = 0;
+                TREE_RED(xp) = 1;
+                tree_rotate_right(a, xp);
+                w = TREE_LEFT(xp);
+            }
+            if ((TREE_LEFT(w) == NULL || !TREE_RED(TREE_LEFT(w))) &&
+                (TREE_RIGHT(w) == NULL || !TREE_RED(TREE_RIGHT(w)))) {
+                TREE_RED(w) = 1;
+                x = xp;
+                xp = TREE_PARENT(x);
+                continue;
+            }
+            if (TREE_LEFT(w) == NULL || !TREE_RED(TREE_LEFT(w))) {
+                TREE_RED(TREE_RIGHT(w)) = 0;
+                TREE_RED(w) = 1;
+                tree_rotate_left(a, w);
+                w = TREE_LEFT(xp);
+            }
+            TREE_RED(w) = TREE_RED(xp);
+            TREE_RED(xp) = 0;
+            TREE_RED(TREE_LEFT(w)) = 0;
+            tree_rotate_right(a, xp);
+        }
+        x = a->tree_root;
+    }
+    if (x != NULL)
+        TREE_RED(x) = 0;
+}
+
+/*
+ * tree_replace - puts new, which may be NULL, in old's place under old's
+ * parent; the caller fixes new's own parent link
+ */
+static void tree_replace(arena_t *a, char *old, char *new)
+{
+    char *p = TREE_PARENT(old);
+
+    if (new != NULL)
+        TREE_PARENT(new) = p;
+    if (p == NULL)
+        a->tree_root = new;
+    else if (TREE_LEFT(p) == old)
+        TREE_LEFT(p) = new;
+    else
+        TREE_RIGHT(p) = new;
+}
+
+/*
+ * tree_rotate_left - lifts x's right child into x's place
+ */
+static void tree_rotate_left(arena_t *a, char *x)
+{
+    char *y = TREE_RIGHT(x);
+
+    TREE_RIGHT(x) = TREE_LEFT(y);
+    if (TREE_LEFT(y))
+        TREE_PARENT(TREE_LEFT(y)) = x;
+    tree_replace(a, x, y);
+    TREE_LEFT(y) = x;
+    TREE_PARENT(x) = y;
+}
+
+/*
+ * tree_rotate_right - lifts x's left child into x's place
+ */
+static void tree_rotate_right(arena_t *a, char *x)
+{
+    char *y = TREE_LEFT(x);
+
+    TREE_LEFT(x) = TREE_RIGHT(y);
+    if (TREE_RIGHT(y))
+        TREE_PARENT(TREE_RIGHT(y)) = x;
+    tree_replace(a, x, y);
+    TREE_RIGHT(y) = x;
+    TREE_PARENT(x) = y;
+}
+
+/*
+ * tree_check - checks the subtree at node and its chains: order, parent
+ * links, no red node with a red child. Adds the blocks to listed and 
+ * returns the subtree's black height, or -1 if two paths disagree.
+ */
+static int tree_check(arena_t *a, char *node, int verbose, int *listed)
+{
+    char *bp, *kid[2];
+    int i, h[2];
+
+    if (node == NULL)
+        return 1;
+
+    for (bp = node; bp != NULL; bp = NEXT_FREE_BLKP(bp)) {
+        if (verbose)
+            printBlock(bp);
+        checkBlock(a, bp);
+        if (GET_SIZE(HDRP(bp)) != GET_SIZE(HDRP(node)))
+            printf("%p: chained to a tree node of another size\n", bp);
+        if (GET_SIZE(HDRP(bp)) < TREE_MIN)
+            printf("%p: list-sized block in the tree\n", bp);
+        (*listed)++;
+    }
+
+    kid[0] = TREE_LEFT(node);
+    kid[1] = TREE_RIGHT(node);
+    for (i = 0; i < 2; i++) {
+        if (kid[i] == NULL) {
+            h[i] = 1;
+            continue;
+        }
+        if (TREE_PARENT(kid[i]) != node)
+            printf("%p: tree child with a wrong parent link\n", kid[i]);
+        if ((GET_SIZE(HDRP(kid[i])) < GET_SIZE(HDRP(node))) != (i == 0))
+            printf("%p: tree child out of order\n", kid[i]);
+        if (TREE_RED(node) && TREE_RED(kid[i]))
+            printf("%p: red tree node with a red child\n", node);
+        h[i] = tree_check(a, kid[i], verbose, listed);
+    }
+    if (h[0] < 0 || h[0] != h[1]) {
+        if (h[0] >= 0 && h[1] >= 0)
+            printf("%p: tree paths differ in black height\n", node);
+        return -1;
+    }
+    return h[0] + !TREE_RED(node);
+}
+
+/*
+ * tlsf_init - empties every TLSF bin and clears both bitmap levels
+ */
+static void tlsf_init(arena_t *a)
+{
+    int fl, sl;
+
+    a->tlsf_fl_bitmap = 0;
+    for (fl = 0; fl < TLSF_FL_COUNT; fl++) {
+        a->tlsf_sl_bitmap[fl] = 0;
+        for (sl = 0; sl < TLSF_SL_COUNT; sl++)
+            a->tlsf_lists[fl][sl] = NULL;
+    }
+}
+
+/*
+ * tlsf_mapping - computes the first- and second-level bin that holds size
+ */
+static void tlsf_mapping(size_t size, int *fl, int *sl)
+{
+    int msb;
+
+    if (size < TLSF_SMALL) {
+        *fl = 0;
+        *sl = size / (TLSF_SMALL / TLSF_SL_COUNT);
+    }
+    else {
+        msb = FLS(size);
+        *fl = msb - TLSF_FL_SHIFT + 1;
+        *sl = (size >> (msb - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+    }
+}
+
+/*
+ * tlsf_find_fit - rounds asize up to the next bin boundary so that every 
+ * block in the bin it maps to is big enough, then uses the bitmaps to find
+ * the first non-empty bin at or above it. No list is ever traversed: if
+ * nothing is found, only the head of the bin asize itself maps to is tried,
+ * so that an exact fit is not missed when the heap would otherwise grow.
+ */
+static void *tlsf_find_fit(arena_t *a, size_t asize)
+{
+    int fl, sl;
+    unsigned int fl_map, sl_map;
+    size_t rsize = asize;
+    void *bp;
+
+    if (asize >= TLSF_SMALL)
+        rsize += ((size_t)1 << (FLS(asize) - TLSF_SL_LOG2)) - 1;
+    tlsf_mapping(rsize, &fl, &sl);
+    if (fl >= TLSF_FL_COUNT)
+        return NULL;
+
+    /* a non-empty bin on the same first level... */
+    sl_map = a->tlsf_sl_bitmap[fl] & (~0U << sl);
+    if (!sl_map) {
+        /* ...or the smallest bin of the next non-empty first level */
+        fl_map = a->tlsf_fl_bitmap & (~0U << (fl + 1));
+        if (!fl_map) {
+            tlsf_mapping(asize, &fl, &sl);
+            bp = a->tlsf_lists[fl][sl];
+            if (bp && asize <= (size_t)GET_SIZE(HDRP(bp)))
+                return bp;
+            return NULL; // No fit
+        }
+        fl = __builtin_ctz(fl_map);
+        sl_map = a->tlsf_sl_bitmap[fl];
+    }
+    sl = __builtin_ctz(sl_map);
+
+    return a->tlsf_lists[fl][sl];
+}
+
+/*
+ * tlsf_insert - inserts free block bp at the front of its bin and marks 
+ * the bin non-empty in both bitmap levels
+ */
+static void tlsf_insert(arena_t *a, void *bp)
+{
+    int fl, sl;
+    char **head;
+
+    tlsf_mapping(GET_SIZE(HDRP(bp)), &fl, &sl);
+    head = &a->tlsf_lists[fl][sl];
+
+    NEXT_FREE_BLKP(bp) = *head;
+    if (*head)
+        PREV_FREE_BLKP(*head) = bp;
+    PREV_FREE_BLKP(bp) = NULL;
+    *head = bp;
+
+    a->tlsf_fl_bitmap |= 1U << fl;
+    a->tlsf_sl_bitmap[fl] |= 1U << sl;
+}
+
+/*
+ * tlsf_remove - unlinks free block bp from its bin, clearing the bitmap
+ * bits when the bin becomes empty. Must be called before the block's 
+ * header is rewritten with a new size.
+ */
+static void tlsf_remove(arena_t *a, void *bp)
+{
+    int fl, sl;
+
+    if (NEXT_FREE_BLKP(bp))
+        PREV_FREE_BLKP(NEXT_FREE_BLKP(bp)) = PREV_FREE_BLKP(bp);
+    if (PREV_FREE_BLKP(bp)) {
+        NEXT_FREE_BLKP(PREV_FREE_BLKP(bp)) = NEXT_FREE_BLKP(bp);
+        return;
+    }
+
+    /* bp was the head of its bin */
+    tlsf_mapping(GET_SIZE(HDRP(bp)), &fl, &sl);
+    a->tlsf_lists[fl][sl] = NEXT_FREE_BLKP(bp);
+    if (a->tlsf_lists[fl][sl] == NULL) {
+        a->tlsf_sl_bitmap[fl] &= ~(1U << sl);
+        if (a->tlsf_sl_bitmap[fl] == 0)
+            a->tlsf_fl_bitmap &= ~(1U << fl);
+    }
+}
+
+/*
+ * tlsf_check - checks every block in the TLSF bins and that both bitmap 
+ * levels agree with which bins are non-empty, returns the block count
+ */
+static int tlsf_check(arena_t *a, int verbose)
+{
+	void *bp;
+	int fl, sl, bfl, bsl, listed = 0;
+
+	for (fl = 0; fl < TLSF_FL_COUNT; fl++) {
+		if (!(a->tlsf_fl_bitmap & (1U << fl)) != !a->tlsf_sl_bitmap[fl])
+			printf("first-level bitmap wrong for level %d\n", fl);
+		for (sl = 0; sl < TLSF_SL_COUNT; sl++) {
+			if (!(a->tlsf_sl_bitmap[fl] & (1U << sl)) != !a->tlsf_lists[fl][sl])
+				printf("second-level bitmap wrong for bin %d/%d\n", fl, sl);
+			for (bp = a->tlsf_lists[fl][sl]; bp != NULL; bp = NEXT_FREE_BLKP(bp)) {
+				if (verbose)
+					printBlock(bp);
+				checkBlock(a, bp);
+				tlsf_mapping(GET_SIZE(HDRP(bp)), &bfl, &bsl);
+				if (bfl != fl || bsl != sl)
+					printf("%p: block in wrong bin %d/%d\n", bp, fl, sl);
+				listed++;
+			}
+		}
+	}
+	return listed;
+}
+
+/*
+ * slab_check - checks that every run with room is in the granule table,
+ * is filed under its own class, and has as many free slots as it claims
+ */
+static void slab_check(arena_t *a, int verbose)
+{
+	run_t *run;
+	void *bp;
+	unsigned int cls, n;
+
+	for (cls = 0; cls < SLAB_CLASSES; cls++) {
+		for (run = a->slab_partial[cls]; run != NULL; run = run->next) {
+			if (verbose)
+				printf("%p: run class %u, %u free\n", run, run->cls, run->nfree);
+			if (a->slab_runs[GRANULE(a, run)] != run)
+				printf("%p: run not in the granule table\n", run);
+			if (run->cls != cls || run->nfree == 0)
+				printf("%p: run in wrong class list %u\n", run, cls);
+			n = (run->end - run->unused) / ((cls + 1) * SLAB_STEP);
+			for (bp = run->free_slots; bp != NULL; bp = *(void **)bp)
+				n++;
+			if (n != run->nfree)
+				printf("%p: run has %u free slots, not %u\n", run, n, run->nfree);
+		}
+	}
+}
+
+/* 
+ * printBlock - prints details of the block, used for debugging purposes
+ */
+static void printBlock(void *bp)
+{
+	int hsize, halloc, fsize, falloc;
+
+	hsize = GET_SIZE(HDRP(bp));
+	halloc = GET_ALLOC(HDRP(bp));
+
+	if (hsize == 0){
+		printf("%p: EOL\n", bp);
+		return;
+	}
+
+	if (halloc)
+		printf("%p: header:[%d:%c%s]\n", bp, hsize, 'a', GET_PREV_ALLOC(HDRP(bp)) ? ":p" : "");
+	else {
+		fsize = GET_SIZE(FTRP(bp));
+		falloc = GET_ALLOC(FTRP(bp));
+		printf("%p:header:[%d:%c] prev:%p next:%p footer:[%d:%c]\n",bp, hsize, 'f', PREV_FREE_BLKP(bp),NEXT_FREE_BLKP(bp), fsize, (falloc ? 'a' : 'f'));
+	}
+}
+
+/*
+ * checkBlock - used to check the alignment, boundary, and footer/header of a block
+ * used for debugging purposes
+ */
+static void checkBlock(arena_t *a, void *bp)
+{
 	
-	for (bp = free_listp; GET_ALLOC(HDRP(bp))==0; bp = NEXT_FREE_BLKP(bp))
-	{
-		if (verbose)
-			printBlock(bp);
-			checkBlock(bp);
+	if (NEXT_FREE_BLKP(bp) && (NEXT_FREE_BLKP(bp)< mem_region_lo(a->region) || NEXT_FREE_BLKP(bp) > mem_region_hi(a->region)))
+		printf("Next pointer: %p is out of bounds\n", NEXT_FREE_BLKP(bp));
+
+	if (PREV_FREE_BLKP(bp) && (PREV_FREE_BLKP(bp)< mem_region_lo(a->region) || PREV_FREE_BLKP(bp) > mem_region_hi(a->region)))
+		printf("Previous pointer: %p is out of bounds\n", PREV_FREE_BLKP(bp));
+	
+	if ((size_t)bp % ALIGNMENT)
+		printf("%p is not aligned\n", bp);
+	
+	if (GET_SIZE(HDRP(bp)) != GET_SIZE(FTRP(bp)) || GET_ALLOC(FTRP(bp)))
+		printf("Header and Footer do not match\n");
+
+	if (GET_ALLOC(HDRP(bp)))
+		printf("%p: allocated block in free list\n", bp);
+
+	if (GET(HDRP(bp)) & ZEROED) {
+		char *p;
+		for (p = (char *)bp + FREE_LINKS; p < (char *)FTRP(bp); p++)
+			if (*p) {
+				printf("%p: ZEROED block has a nonzero byte at %p\n", bp, p);
+				break;
+			}
+	}
+}
+
+/*
+ * mm_checkheap - checks every arena for errors. Used for debugging purposes
+ */
+void mm_checkheap(int verbose)
+{
+	int i;
+
+	for (i = 0; i < narenas; i++)
+		arena_check(&arenas[i], verbose);
+}
+
+/*
+ * arena_check - calls checkBlock and printBlock to check for errors in the 
+ * heap of arena a and in every list of its free-block index
+ */
+static void arena_check(arena_t *a, int verbose)
+{
+	void *bp = a->heap_listp; 
+	int listed, walked = 0;
+
+	if (verbose)
+		printf("Heap (%p):\n", a->heap_listp);
+		
+	if ((GET_SIZE(HDRP(a->heap_listp)) != DSIZE) ||!GET_ALLOC(HDRP(a->heap_listp)))
+		printf("Bad prologue header\n");
+
+	listed = engine->check(a, verbose);
+	slab_check(a, verbose);
+
+	for (bp = a->heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+		if (!GET_ALLOC(HDRP(bp)) != !GET_PREV_ALLOC(HDRP(NEXT_BLKP(bp))))
+			printf("%p: successor's prev-alloc bit is wrong\n", bp);
+		if (GET_ALLOC(HDRP(bp)))
+			continue;
+		walked++;
+		if (!GET_ALLOC(HDRP(NEXT_BLKP(bp))))
+			printf("%p: free block not coalesced with its successor\n", bp);
 	}
+
+	if (listed != walked)
+		printf("%d free blocks in heap but %d in free lists\n", walked, listed);
 	
 	if (verbose)
 		printBlock(bp);
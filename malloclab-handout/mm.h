@@ -1,17 +1,77 @@
 #include <stdio.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Free-block index engines, selected by mm_opts.engine */
+#define MM_ENGINE_SEGLIST 0   /* segregated lists with first-fit search */
+#define MM_ENGINE_TLSF    1   /* two-level segregated fit, O(1) lookup */
+#define MM_NUM_ENGINES    2
+
+/* Heap growth policies, selected by mm_opts.growth */
+#define MM_GROWTH_FIXED    0  /* grow by a fixed chunk */
+#define MM_GROWTH_ADAPTIVE 1  /* geometric steps that decay when demand stalls */
+
+/* Placement policies of the segregated lists, selected by mm_opts.placement */
+#define MM_FIT_FIRST 0    /* first block that fits */
+#define MM_FIT_NEXT  1    /* first fit resuming where the last search left off */
+#define MM_FIT_BEST  2    /* smallest block that fits */
+#define MM_FIT_GOOD  3    /* best fit among the first mm_opts.fit_scan */
+#define MM_NUM_FITS  4
+
+/* Most arenas a thread-safe heap is split into */
+#define MM_MAX_ARENAS 8
+
+/* 
+ * Allocator options. Fields are read by mm_init, so set them before
+ * calling it; they take effect for the heap that mm_init creates.
+ */
+typedef struct {
+    int engine;     /* one of the MM_ENGINE_xxx constants */
+    int thread_safe;    /* lock the heap and give each thread a block cache */
+    int arenas;         /* thread-safe mode: arenas to use, 0 for one per CPU */
+    size_t mmap_threshold;  /* requests this big get their own mapping, 0 for never */
+    size_t trim_threshold;  /* free blocks this big go back to the OS, 0 for never */
+    int defer_coalesce;     /* park small frees on quick lists, coalesce in batches */
+    int growth;             /* one of the MM_GROWTH_xxx constants */
+    int placement;          /* one of the MM_FIT_xxx constants */
+    int fit_scan;           /* good fit: most list nodes visited */
+    size_t prefault;        /* bytes of each arena to fault in at init, 0 for none */
+} mm_opts_t;
+
+extern mm_opts_t mm_opts;
+
 extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
+/* reads no header only for thread-cached sizes above the slab sizes */
+extern void mm_free_sized(void *ptr, size_t size);
+extern size_t mm_usable_size(void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+extern void *mm_calloc(size_t nmemb, size_t size);
+extern void *mm_memalign(size_t align, size_t size);
+extern size_t mm_malloc_batch(size_t size, size_t n, void **ptrs);
+extern void mm_free_batch(void **ptrs, size_t n);
 extern void *extend_heap(size_t words);
-static void *find_fit(size_t asize);
-static void place(void *bp, size_t asize);
-static void *coalesce(void *bp);
-static void insert_front(void *bp);
-static void rmv_from_free(void *bp);
-static void mm_checkheap(int verbose);
-static void printBlock(void *bp);
+extern void mm_checkheap(int verbose);
+extern size_t mm_mapped_bytes(void);
+extern int mm_trim(void);
+
+/* 
+ * An independent heap, in a region of its own, that is dropped as a whole.
+ * Its blocks come from and go back to the mm_heap_xxx calls only.
+ */
+typedef struct mm_heap mm_heap_t;
+
+extern mm_heap_t *mm_heap_create(size_t size);
+extern void mm_heap_destroy(mm_heap_t *h);
+extern void *mm_heap_malloc(mm_heap_t *h, size_t size);
+extern void *mm_heap_memalign(mm_heap_t *h, size_t align, size_t size);
+extern void mm_heap_free(mm_heap_t *h, void *ptr);
+extern void *mm_heap_realloc(mm_heap_t *h, void *ptr, size_t size);
+extern size_t mm_heap_size(mm_heap_t *h);
+extern void mm_heap_check(mm_heap_t *h, int verbose);
 
 /* 
  * Students work in teams of two.  Teams enter their team name, 
@@ -28,3 +88,6 @@ typedef struct {
 
 extern team_t team;
 
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,37 @@
+/*
+ * mm_cxx.h - Heap setup shared by the C++ front ends to mm
+ *
+ * mm_new.cc and mm_pmr.cc both set up the heap on first use. Being inline,
+ * heap_ready has a single local static across every file that includes
+ * it, so a program that links both still sets up one heap, once.
+ */
+#ifndef MM_CXX_H
+#define MM_CXX_H
+
+#include <cstdlib>
+
+#include "mm.h"
+#include "memlib.h"
+
+namespace mm {
+
+/*
+ * heap_ready - sets up a thread-safe heap on the first call. The guard of
+ * a local static makes threads that race to the first call wait for one
+ * setup.
+ */
+inline void heap_ready()
+{
+    static const bool ready = [] {
+        mem_init();
+        mm_opts.thread_safe = 1;
+        return mm_init() == 0;
+    }();
+
+    if (!ready)
+        std::abort();
+}
+
+} // namespace mm
+
+#endif
@@ -0,0 +1,163 @@
+/*
+ * mm_new.cc - Replaces the global operator new and delete with mm
+ *
+ * Linking this file into a C++ program sends every global new and delete
+ * (plain, array, sized, aligned and nothrow) to a thread-safe mm heap,
+ * which is set up by the first new. Sized deletes pass the size straight
+ * to mm_free_sized, which puts blocks of 129-512 bytes into their cache 
+ * bin by size instead of reading the header. Aligned forms use 
+ * mm_memalign; the plain forms only ever need mm's 16-byte alignment, 
+ * which covers __STDCPP_DEFAULT_NEW_ALIGNMENT__.
+ */
+#include <new>
+#include <cstddef>
+
+#include "mm_cxx.h"
+
+namespace {
+
+/*
+ * allocate - size bytes aligned to align, calling the new handler until it
+ * succeeds; throws bad_alloc, or returns nullptr if nothrow, once there
+ * is no handler left
+ */
+void *allocate(std::size_t size, std::size_t align, bool nothrow)
+{
+    void *p;
+
+    mm::heap_ready();
+    if (size == 0)
+        size = 1;
+    for (;;) {
+        p = (align > __STDCPP_DEFAULT_NEW_ALIGNMENT__) ? mm_memalign(align, size)
+                                                        : mm_malloc(size);
+        if (p != nullptr)
+            return p;
+
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            if (nothrow)
+                return nullptr;
+            throw std::bad_alloc();
+        }
+        if (!nothrow)
+            handler();
+        else {
+            try {
+                handler();
+            } catch (...) {
+                return nullptr;
+            }
+        }
+    }
+}
+
+/*
+ * release_sized - frees a block new made for size bytes
+ */
+inline void release_sized(void *p, std::size_t size)
+{
+    mm_free_sized(p, size ? size : 1);
+}
+
+} // namespace
+
+void *operator new(std::size_t size)
+{
+    return allocate(size, 0, false);
+}
+
+void *operator new[](std::size_t size)
+{
+    return allocate(size, 0, false);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size, 0, true);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size, 0, true);
+}
+
+void *operator new(std::size_t size, std::align_val_t align)
+{
+    return allocate(size, static_cast<std::size_t>(align), false);
+}
+
+void *operator new[](std::size_t size, std::align_val_t align)
+{
+    return allocate(size, static_cast<std::size_t>(align), false);
+}
+
+void *operator new(std::size_t size, std::align_val_t align, const std::nothrow_t &) noexcept
+{
+    return allocate(size, static_cast<std::size_t>(align), true);
+}
+
+void *operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t &) noexcept
+{
+    return allocate(size, static_cast<std::size_t>(align), true);
+}
+
+void operator delete(void *p) noexcept
+{
+    mm_free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    mm_free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    mm_free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+    mm_free(p);
+}
+
+void operator delete(void *p, std::size_t size) noexcept
+{
+    release_sized(p, size);
+}
+
+void operator delete[](void *p, std::size_t size) noexcept
+{
+    release_sized(p, size);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+    mm_free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept
+{
+    mm_free(p);
+}
+
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    mm_free(p);
+}
+
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    mm_free(p);
+}
+
+void operator delete(void *p, std::size_t size, std::align_val_t) noexcept
+{
+    release_sized(p, size);
+}
+
+void operator delete[](void *p, std::size_t size, std::align_val_t) noexcept
+{
+    release_sized(p, size);
+}
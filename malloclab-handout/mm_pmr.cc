@@ -0,0 +1,176 @@
+/*
+ * mm_pmr.cc - std::pmr memory resources on top of mm
+ *
+ * Both resources set the heap up on construction, as mm_new.cc does on
+ * the first new. A region keeps its chunks in a list threaded through
+ * their headers, newest first, and only ever carves from the newest one:
+ * a request that does not fit in what is left of it opens a new chunk,
+ * and the tail of the old one is wasted until the region is reset.
+ */
+#include <cstdint>
+#include <new>
+
+#include "mm_cxx.h"
+#include "mm_pmr.h"
+
+namespace mm {
+
+/* payloads of chunks and plain mm blocks are aligned to this */
+static const std::size_t MM_ALIGN = 16;
+static const std::size_t CHUNK_HDR = 16;
+
+/*
+ * align_up - p rounded up to a multiple of align, a power of two
+ */
+static inline char *align_up(char *p, std::size_t align)
+{
+    return (char *)(((std::uintptr_t)p + align - 1) & ~(std::uintptr_t)(align - 1));
+}
+
+heap_resource::heap_resource()
+{
+    heap_ready();
+}
+
+/*
+ * heap_resource::do_allocate - an mm block, throwing bad_alloc on failure
+ */
+void *heap_resource::do_allocate(std::size_t bytes, std::size_t align)
+{
+    void *p;
+
+    if (bytes == 0)
+        bytes = 1;
+    p = (align > MM_ALIGN) ? mm_memalign(align, bytes) : mm_malloc(bytes);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+/*
+ * heap_resource::do_deallocate - frees the block with its size
+ */
+void heap_resource::do_deallocate(void *p, std::size_t bytes, std::size_t)
+{
+    mm_free_sized(p, bytes ? bytes : 1);
+}
+
+bool heap_resource::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+{
+    return dynamic_cast<const heap_resource *>(&other) != nullptr;
+}
+
+heap_resource *heap()
+{
+    static heap_resource resource;
+
+    return &resource;
+}
+
+region_resource::region_resource(std::size_t chunk)
+    : cur(nullptr), end(nullptr), chunks(nullptr),
+      first_size(chunk < 2 * CHUNK_HDR ? 2 * CHUNK_HDR : chunk), next_size(first_size)
+{
+    heap_ready();
+}
+
+region_resource::~region_resource()
+{
+    release();
+}
+
+/*
+ * region_resource::reset - frees every chunk but the largest, which need
+ * not be the newest since an oversized request gets a chunk of its own
+ * size, and starts carving from its beginning again. A region reused
+ * per request thus stops calling mm once it has grown to fit one.
+ */
+void region_resource::reset()
+{
+    chunk_t *c, *next, *keep;
+
+    if (chunks == nullptr)
+        return;
+    keep = chunks;
+    for (c = chunks->next; c != nullptr; c = c->next)
+        if (c->size > keep->size)
+            keep = c;
+    for (c = chunks; c != nullptr; c = next) {
+        next = c->next;
+        if (c != keep)
+            mm_free_sized(c, c->size);
+    }
+    keep->next = nullptr;
+    chunks = keep;
+    cur = (char *)keep + CHUNK_HDR;
+    end = (char *)keep + keep->size;
+}
+
+/*
+ * region_resource::release - gives every chunk back to mm
+ */
+void region_resource::release()
+{
+    reset();
+    if (chunks != nullptr)
+        mm_free_sized(chunks, chunks->size);
+    chunks = nullptr;
+    cur = end = nullptr;
+    next_size = first_size;
+}
+
+/*
+ * region_resource::do_allocate - bumps the cursor of the newest chunk
+ */
+void *region_resource::do_allocate(std::size_t bytes, std::size_t align)
+{
+    char *p = align_up(cur, align);
+
+    if (cur == nullptr || p < cur || p > end || (std::size_t)(end - p) < bytes)
+        return refill(bytes, align);
+    cur = p + bytes;
+    return p;
+}
+
+/*
+ * region_resource::refill - opens a new chunk for a request the newest
+ * chunk cannot hold, and carves the request from it
+ */
+void *region_resource::refill(std::size_t bytes, std::size_t align)
+{
+    std::size_t need = CHUNK_HDR + bytes + (align > MM_ALIGN ? align : 0);
+    std::size_t size = next_size;
+    chunk_t *c;
+    char *p;
+
+    if (need < bytes)       /* overflowed */
+        throw std::bad_alloc();
+    if (size < need)
+        size = need;
+    if ((c = (chunk_t *)mm_malloc(size)) == nullptr)
+        throw std::bad_alloc();
+    c->next = chunks;
+    c->size = size;
+    chunks = c;
+    if (next_size < MAX_CHUNK)
+        next_size *= 2;
+
+    p = align_up((char *)c + CHUNK_HDR, align);
+    cur = p + bytes;
+    end = (char *)c + size;
+    return p;
+}
+
+/*
+ * region_resource::do_deallocate - nothing; memory comes back on reset
+ */
+void region_resource::do_deallocate(void *, std::size_t, std::size_t)
+{
+}
+
+bool region_resource::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+{
+    return this == &other;
+}
+
+} // namespace mm
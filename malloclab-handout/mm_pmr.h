@@ -0,0 +1,72 @@
+/*
+ * mm_pmr.h - std::pmr memory resources on top of mm
+ *
+ * heap_resource hands every allocation to the mm heap and frees it with
+ * mm_free_sized. region_resource bump-allocates out of large chunks it
+ * gets from mm_malloc, ignores deallocation, and gives all of its memory
+ * back at once on reset, so a request's objects cost a pointer increment
+ * each and no per-object free or coalescing.
+ */
+#ifndef MM_PMR_H
+#define MM_PMR_H
+
+#include <cstddef>
+#include <memory_resource>
+
+namespace mm {
+
+/* A memory resource over the mm heap; every instance is equal */
+class heap_resource : public std::pmr::memory_resource {
+public:
+    heap_resource();
+
+protected:
+    void *do_allocate(std::size_t bytes, std::size_t align) override;
+    void do_deallocate(void *p, std::size_t bytes, std::size_t align) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+};
+
+/* The heap_resource shared by the whole program */
+heap_resource *heap();
+
+/*
+ * A monotonic resource that carves allocations from chunks of mm memory.
+ * Chunks start at the size given and double, up to MAX_CHUNK, as the
+ * region fills; a request bigger than that gets a chunk of its own.
+ */
+class region_resource : public std::pmr::memory_resource {
+public:
+    static const std::size_t DEFAULT_CHUNK = 16 * 1024;
+    static const std::size_t MAX_CHUNK = 1024 * 1024;
+
+    explicit region_resource(std::size_t chunk = DEFAULT_CHUNK);
+    ~region_resource();
+    region_resource(const region_resource &) = delete;
+    region_resource &operator=(const region_resource &) = delete;
+
+    void reset();       /* frees everything, keeping the largest chunk */
+    void release();     /* frees everything and gives every chunk back */
+
+protected:
+    void *do_allocate(std::size_t bytes, std::size_t align) override;
+    void do_deallocate(void *p, std::size_t bytes, std::size_t align) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+private:
+    struct chunk_t {
+        chunk_t *next;      /* next older chunk */
+        std::size_t size;   /* bytes in the chunk, this header included */
+    };
+
+    void *refill(std::size_t bytes, std::size_t align);
+
+    char *cur;              /* next free byte of the newest chunk */
+    char *end;              /* end of the newest chunk */
+    chunk_t *chunks;        /* newest chunk first */
+    std::size_t first_size; /* size of the first chunk */
+    std::size_t next_size;  /* size of the next chunk */
+};
+
+} // namespace mm
+
+#endif
@@ -0,0 +1,287 @@
+/*
+ * mm_preload.c - Exposes mm as the process's malloc, for LD_PRELOAD
+ *
+ * Built with mm.c and memlib.c into libmm.so, whose malloc, free, calloc,
+ * realloc and aligned allocation entry points take the place of libc's
+ * in any program run with LD_PRELOAD=./libmm.so. The heap is set up on
+ * the first call, in thread-safe mode, over memlib regions of MAX_HEAP
+ * bytes of reserved address space each, committed only as the heap grows
+ * into them. Requests made while it is being set up (sysconf, for one,
+ * may malloc) are served from a static buffer that is never reused. The
+ * environment can tune the heap:
+ *
+ *   MM_HEAP_SIZE       address space each region reserves (MAX_HEAP;
+ *                      an arena uses at most 4 GB of it)
+ *   MM_HUGEPAGES       back the heap with 2 MB pages if set to 1 (0)
+ *   MM_ARENAS          arenas to split the heap into (default one per CPU)
+ *   MM_MMAP_THRESHOLD  requests this big get their own mapping (128 KB)
+ *   MM_TRIM_THRESHOLD  free space this big at the top is trimmed (128 KB)
+ *   MM_PREFAULT        bytes of each arena to fault in at setup (0)
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define BOOT_SIZE (64*1024)         /* bytes for requests made during setup */
+#define BOOT_HDR 16                 /* size word ahead of a boot block */
+#define DEFAULT_MMAP (128*1024)     /* matches libc's initial thresholds */
+#define DEFAULT_TRIM (128*1024)
+
+#define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+
+static char boot[BOOT_SIZE] __attribute__((aligned(16)));
+static size_t boot_used;
+static int ready;                   /* the heap is set up */
+static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread int initializing __attribute__((tls_model("initial-exec")));
+
+static int mm_ready(void);
+static size_t env_size(const char *name, size_t dflt);
+static void *boot_alloc(size_t align, size_t size);
+static int is_boot(void *ptr);
+static void *aligned(size_t align, size_t size);
+
+/*
+ * malloc - mm_malloc, treating a request for 0 bytes as one for 1
+ */
+void *malloc(size_t size)
+{
+    void *p;
+
+    if (!mm_ready())
+        return boot_alloc(16, size);
+    if ((p = mm_malloc(size ? size : 1)) == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+/*
+ * free - mm_free; boot blocks are never reused
+ */
+void free(void *ptr)
+{
+    if (ptr == NULL || is_boot(ptr))
+        return;
+    mm_free(ptr);
+}
+
+/*
+ * calloc - mm_calloc, which checks nmemb * size for overflow
+ */
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+
+    if (size && nmemb > (size_t)-1 / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (!mm_ready())
+        return boot_alloc(16, nmemb * size);    /* the buffer is still zero */
+    if (nmemb == 0 || size == 0)
+        nmemb = size = 1;
+    if ((p = mm_calloc(nmemb, size)) == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+/*
+ * realloc - mm_realloc; a boot block moves to the heap
+ */
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    if (ptr == NULL)
+        return malloc(size);
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    if (is_boot(ptr)) {
+        if ((p = malloc(size)) != NULL)
+            memcpy(p, ptr, MIN(size, malloc_usable_size(ptr)));
+        return p;
+    }
+    if ((p = mm_realloc(ptr, size)) == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+/*
+ * reallocarray - realloc of nmemb * size bytes, failing on overflow.
+ * libc's own would call its realloc, not this one.
+ */
+void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+    if (size && nmemb > (size_t)-1 / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return realloc(ptr, nmemb * size);
+}
+
+/*
+ * posix_memalign - mm_memalign for an alignment that is a power of two
+ *    and a multiple of sizeof(void *)
+ */
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    void *p;
+
+    if (align % sizeof(void *) != 0 || (align & (align - 1)) != 0)
+        return EINVAL;
+    if ((p = aligned(align, size)) == NULL)
+        return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+/*
+ * aligned_alloc - mm_memalign for an alignment that is a power of two
+ */
+void *aligned_alloc(size_t align, size_t size)
+{
+    void *p;
+
+    if (align == 0 || (align & (align - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((p = aligned(align, size)) == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+/*
+ * memalign - mm_memalign, rounding the alignment up to a power of two
+ */
+void *memalign(size_t align, size_t size)
+{
+    size_t a = 16;
+    void *p;
+
+    while (a < align)
+        a <<= 1;
+    if ((p = aligned(a, size)) == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+/*
+ * valloc - a page-aligned block
+ */
+void *valloc(size_t size)
+{
+    return memalign(mem_pagesize(), size);
+}
+
+/*
+ * pvalloc - a page-aligned block of whole pages
+ */
+void *pvalloc(size_t size)
+{
+    size_t page = mem_pagesize();
+
+    return memalign(page, (size + page - 1) & ~(page - 1));
+}
+
+/*
+ * malloc_usable_size - mm_usable_size, or the recorded size of a boot block
+ */
+size_t malloc_usable_size(void *ptr)
+{
+    if (ptr == NULL)
+        return 0;
+    if (is_boot(ptr))
+        return *(size_t *)((char *)ptr - BOOT_HDR);
+    return mm_usable_size(ptr);
+}
+
+/*
+ * mm_ready - sets up the heap on the first call and returns 1, or returns
+ *    0 to a call the setup itself makes, which must use the boot buffer
+ */
+static int mm_ready(void)
+{
+    if (__atomic_load_n(&ready, __ATOMIC_ACQUIRE))
+        return 1;
+    if (initializing)
+        return 0;
+
+    pthread_mutex_lock(&init_lock);
+    if (!ready) {
+        initializing = 1;
+        mem_set_max_heap(env_size("MM_HEAP_SIZE", mem_max_heap()));
+        mem_set_hugepages((int)env_size("MM_HUGEPAGES", 0));
+        mem_init();
+        mm_opts.thread_safe = 1;
+        mm_opts.arenas = (int)env_size("MM_ARENAS", 0);
+        mm_opts.mmap_threshold = env_size("MM_MMAP_THRESHOLD", DEFAULT_MMAP);
+        mm_opts.trim_threshold = env_size("MM_TRIM_THRESHOLD", DEFAULT_TRIM);
+        mm_opts.prefault = env_size("MM_PREFAULT", 0);
+        if (mm_init() < 0) {
+            static const char msg[] = "libmm: mm_init failed\n";
+            write(STDERR_FILENO, msg, sizeof(msg) - 1);
+            abort();
+        }
+        initializing = 0;
+        __atomic_store_n(&ready, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&init_lock);
+    return 1;
+}
+
+/*
+ * env_size - the number in environment variable name, or dflt if unset
+ */
+static size_t env_size(const char *name, size_t dflt)
+{
+    char *s = getenv(name);
+
+    return (s != NULL && *s != '\0') ? strtoul(s, NULL, 0) : dflt;
+}
+
+/*
+ * boot_alloc - carves an aligned block of size bytes from the boot buffer,
+ *    recording its size just ahead of it, or returns NULL once it is spent
+ */
+static void *boot_alloc(size_t align, size_t size)
+{
+    uintptr_t p = (uintptr_t)boot + boot_used + BOOT_HDR;
+
+    p = (p + align - 1) & ~(uintptr_t)(align - 1);
+    if (size > BOOT_SIZE || p + size > (uintptr_t)boot + BOOT_SIZE) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    *(size_t *)(p - BOOT_HDR) = size;
+    boot_used = (p + size + 15 - (uintptr_t)boot) & ~(size_t)15;
+    return (void *)p;
+}
+
+/*
+ * is_boot - returns whether ptr came from the boot buffer
+ */
+static int is_boot(void *ptr)
+{
+    return (char *)ptr >= boot && (char *)ptr < boot + BOOT_SIZE;
+}
+
+/*
+ * aligned - an align-aligned block of size bytes, align a power of two
+ */
+static void *aligned(size_t align, size_t size)
+{
+    if (!mm_ready())
+        return boot_alloc(MAX(align, 16), size);
+    return mm_memalign(align, size ? size : 1);
+}
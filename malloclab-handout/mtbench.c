@@ -0,0 +1,155 @@
+/*
+ * mtbench.c - Multithreaded throughput benchmark for mm.c
+ *
+ * Runs the same small-block malloc/free workload on 1, 2, 4, ... up to
+ * -n threads against one heap in thread-safe mode, and reports the total
+ * throughput for each thread count and its speedup over one thread.
+ * Each thread keeps a window of live blocks and, at every step, frees a
+ * random one if it is live or allocates a random size into it if not.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define WINDOW 64           /* live blocks per thread */
+#define MAX_SIZE 256        /* largest request */
+#define DEFAULT_THREADS 8
+#define DEFAULT_OPS 200000  /* operations per thread */
+
+static int ops_per_thread = DEFAULT_OPS;
+
+static void usage(void);
+
+/*
+ * worker - runs ops_per_thread mallocs and frees over a private window
+ */
+static void *worker(void *arg)
+{
+    unsigned int seed = (unsigned int)(size_t)arg * 2654435761u + 1;
+    void *live[WINDOW];
+    size_t size;
+    int i, slot;
+
+    memset(live, 0, sizeof(live));
+    for (i = 0; i < ops_per_thread; i++) {
+        seed ^= seed << 13;     /* xorshift32 */
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        slot = seed % WINDOW;
+        if (live[slot]) {
+            mm_free(live[slot]);
+            live[slot] = NULL;
+        }
+        else {
+            size = 1 + (seed >> 8) % MAX_SIZE;
+            if ((live[slot] = mm_malloc(size)) == NULL) {
+                fprintf(stderr, "mtbench: mm_malloc(%zu) failed\n", size);
+                exit(1);
+            }
+            *(char *)live[slot] = (char)i;
+        }
+    }
+    for (slot = 0; slot < WINDOW; slot++)
+        mm_free(live[slot]);
+    return NULL;
+}
+
+/*
+ * run - times nthreads workers on a fresh heap, returns elapsed seconds
+ */
+static double run(int nthreads)
+{
+    pthread_t *tids = malloc(nthreads * sizeof(pthread_t));
+    struct timespec start, end;
+    int i;
+
+    mem_reset_brk();
+    if (mm_init() < 0) {
+        fprintf(stderr, "mtbench: mm_init failed\n");
+        exit(1);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < nthreads; i++)
+        pthread_create(&tids[i], NULL, worker, (void *)(size_t)(i + 1));
+    for (i = 0; i < nthreads; i++)
+        pthread_join(tids[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    free(tids);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    int max_threads = DEFAULT_THREADS;
+    double secs, kops, base = 0;
+    int c, n;
+
+    while ((c = getopt(argc, argv, "n:o:e:a:h")) != EOF) {
+        switch (c) {
+        case 'n': /* Largest thread count */
+            max_threads = atoi(optarg);
+            break;
+        case 'o': /* Operations per thread */
+            ops_per_thread = atoi(optarg);
+            break;
+        case 'a': /* Arenas, 0 for one per CPU */
+            mm_opts.arenas = atoi(optarg);
+            break;
+        case 'e': /* Select the mm free-block index engine */
+            if (!strcmp(optarg, "seglist"))
+                mm_opts.engine = MM_ENGINE_SEGLIST;
+            else if (!strcmp(optarg, "tlsf"))
+                mm_opts.engine = MM_ENGINE_TLSF;
+            else {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (max_threads < 1 || ops_per_thread < 1) {
+        usage();
+        exit(1);
+    }
+
+    mm_opts.thread_safe = 1;
+    mem_init();
+
+    printf("%8s%10s%12s%10s\n", "threads", "secs", "Kops", "speedup");
+    for (n = 1; n <= max_threads; n *= 2) {
+        secs = run(n);
+        kops = (double)n * ops_per_thread / secs / 1000.0;
+        if (n == 1)
+            base = kops;
+        printf("%8d%10.4f%12.0f%9.2fx\n", n, secs, kops, kops / base);
+    }
+    return 0;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mtbench [-h] [-n <threads>] [-o <ops>] [-e <engine>] [-a <arenas>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-a <arenas>   Split the heap into <arenas> arenas (default one per CPU).\n");
+    fprintf(stderr, "\t-e <eng>      Use free-block index <eng>: seglist (default) or tlsf.\n");
+    fprintf(stderr, "\t-h            Print this message.\n");
+    fprintf(stderr, "\t-n <threads>  Run 1, 2, 4, ... up to <threads> threads (default %d).\n", DEFAULT_THREADS);
+    fprintf(stderr, "\t-o <ops>      Operations per thread (default %d).\n", DEFAULT_OPS);
+}
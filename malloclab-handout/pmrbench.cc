@@ -0,0 +1,131 @@
+/*
+ * pmrbench.cc - Per-request allocation benchmark for mm's pmr resources
+ *
+ * Serves a stream of simulated requests, each of which builds a map of
+ * string fields, a list of string tokens and a vector of ints, and then
+ * drops them all. Every request is run on three resources: mm's
+ * heap_resource, which mallocs and frees each object on its own; a
+ * region_resource reset after each request; and, for reference, the
+ * standard monotonic_buffer_resource over the heap, released after each
+ * request. Reports the time of each and its speedup over the heap.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <unistd.h>
+#include <list>
+#include <map>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include "mm_pmr.h"
+
+#define DEFAULT_OBJS 200        /* objects of each kind per request */
+#define DEFAULT_REQUESTS 20000
+#define MIN_STRING 16           /* past the short-string buffer */
+#define MAX_STRING 128
+
+static int objs = DEFAULT_OBJS;
+static int requests = DEFAULT_REQUESTS;
+static volatile size_t sink;    /* keeps the work from being optimized away */
+
+static void usage(void);
+
+/*
+ * serve - builds and drops the objects of request number req on r
+ */
+static void serve(std::pmr::memory_resource *r, unsigned int req)
+{
+    std::pmr::map<int, std::pmr::string> fields(r);
+    std::pmr::list<std::pmr::string> tokens(r);
+    std::pmr::vector<int> ints(r);
+    unsigned int seed = req * 2654435761u + 1;
+    int i;
+
+    for (i = 0; i < objs; i++) {
+        seed = seed * 1103515245 + 12345;
+        fields.try_emplace((int)(seed >> 1), MIN_STRING + (seed >> 8) % (MAX_STRING - MIN_STRING), 'f');
+        tokens.emplace_back(MIN_STRING + (seed >> 16) % MIN_STRING, 't');
+        ints.push_back(i);
+    }
+    sink += fields.size() + tokens.size() + ints.size();
+}
+
+/*
+ * elapsed - seconds from start to now
+ */
+static double elapsed(const struct timespec *start)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    struct timespec start;
+    double heap_secs, region_secs, mono_secs;
+    int c, req;
+
+    while ((c = getopt(argc, argv, "n:r:h")) != EOF) {
+        switch (c) {
+        case 'n': /* Objects of each kind per request */
+            objs = atoi(optarg);
+            break;
+        case 'r': /* Requests served */
+            requests = atoi(optarg);
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (objs < 1 || requests < 1) {
+        usage();
+        exit(1);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (req = 0; req < requests; req++)
+        serve(mm::heap(), req);
+    heap_secs = elapsed(&start);
+
+    mm::region_resource region;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (req = 0; req < requests; req++) {
+        serve(&region, req);
+        region.reset();
+    }
+    region_secs = elapsed(&start);
+
+    std::pmr::monotonic_buffer_resource mono(mm::heap());
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (req = 0; req < requests; req++) {
+        serve(&mono, req);
+        mono.release();
+    }
+    mono_secs = elapsed(&start);
+
+    printf("%-12s%10s%10s\n", "resource", "secs", "speedup");
+    printf("%-12s%10.4f%9.2fx\n", "heap", heap_secs, 1.0);
+    printf("%-12s%10.4f%9.2fx\n", "region", region_secs, heap_secs / region_secs);
+    printf("%-12s%10.4f%9.2fx\n", "monotonic", mono_secs, heap_secs / mono_secs);
+    return 0;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: pmrbench [-h] [-n <objects>] [-r <requests>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h             Print this message.\n");
+    fprintf(stderr, "\t-n <objects>   Objects of each kind per request (default %d).\n", DEFAULT_OBJS);
+    fprintf(stderr, "\t-r <requests>  Requests served (default %d).\n", DEFAULT_REQUESTS);
+}